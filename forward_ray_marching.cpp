@@ -5,6 +5,9 @@
 #include <vector>
 #include <sstream>
 #include "geometry.h"
+#include "renderer.h"
+#include "tile_farm.h"
+#include "float8.h"
 
 const Vec3 BACKGROUND_COLOR(0.572f, 0.772f, 0.921f);
 
@@ -44,43 +47,118 @@ Vec3 shade_sphere(const Vec3& hit_point_entrance, const Vec3& hit_point_exit, co
     return BACKGROUND_COLOR * transmission + result;
 }
 
-void forward_ray_marching(int width, int height, float sigma_a, int num_steps) {
-    std::vector<unsigned char> image(width * height * 3, 0);
+float8 transfer_function8(float8 distance, float sigma_a) {
+    return max8(broadcast8(0.0f), min8(exp8(-distance * sigma_a), broadcast8(1.0f)));
+}
 
-    Vec3 camera(0.0f, 0.0f, 0.0f);
-    Material material(Vec3(0.0f), Vec3(1.0f), 0.1f, 0.9f, 0.5f, 1.0f, 0.0f, 32.0f, MaterialType::NONE);
-    Sphere sphere(Vec3(0.0f, 0.0f, -5.0f), 3.0f, material);
-    Light light(Vec3(4.0f, 4.0f, -7.0f), Vec3(1.3f, 0.3f, 0.9f), 10.0f);
+// get_light_intensity() at eight points, as a multiple of light.color
+float8 get_light_weight8(const Vec3x8& particle_hit_point, const Sphere& sphere, const Light& light, float8 step_size, float sigma_a) {
+    Vec3x8 light_position(light.position);
+    Vec3x8 to_particle = particle_hit_point - light_position;
+    Vec3x8 light_dir = to_particle / to_particle.length();
+
+    Vec3x8 oc = light_position - Vec3x8(sphere.center);
+    float8 a = light_dir.dot(light_dir);
+    float8 b = 2.0f * oc.dot(light_dir);
+    float8 c = oc.dot(oc) - sphere.radius * sphere.radius;
+    float8 discriminant = b * b - 4.0f * a * c;
+    float8 t = (-b - sqrt8(max8(discriminant, broadcast8(0.0f)))) / (2.0f * a);
+    mask8 hit = greaterEqual8(discriminant, broadcast8(0.0f)) & greaterEqual8(t, broadcast8(0.0f));
+
+    float8 light_transfer_distance = (particle_hit_point - (light_position + light_dir * t)).length();
+    return select(hit, step_size * transfer_function8(light_transfer_distance, sigma_a), broadcast8(0.0f));
+}
+
+// shade_sphere() for eight pixels, one per lane
+Vec3x8 shade_sphere8(const Vec3x8& hit_point_entrance, const Vec3x8& hit_point_exit, const Sphere& sphere, const Light& light, float sigma_a, int num_steps) {
+    float8 steps = broadcast8(float(num_steps));
+    float8 step_size = (hit_point_exit - hit_point_entrance).length() / steps;
+    Vec3x8 step_direction = (hit_point_exit - hit_point_entrance) / steps;
+    Vec3x8 current_point = hit_point_entrance + step_direction * broadcast8(0.5f);
+
+    float8 attenuation = transfer_function8(step_size, sigma_a);
+    float8 transmission = broadcast8(1.0f);
+    float8 light_sum = broadcast8(0.0f);
+
+    for (int i = 0; i < num_steps; ++i) {
+        float8 light_weight = get_light_weight8(current_point, sphere, light, step_size, sigma_a);
+        transmission *= attenuation;
+        light_sum += light_weight * transmission;
+        current_point += step_direction;
+    }
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
+    return Vec3x8(BACKGROUND_COLOR) * transmission + Vec3x8(sphere.material.color) + Vec3x8(light.color) * light_sum;
+}
 
-            float px = (2 * (x + 0.5f) / float(width) - 1) * width / float(height);
-            float py = (1 - 2 * (y + 0.5f) / float(height));
+class ForwardMarchIntegrator : public Integrator {
+public:
+    ForwardMarchIntegrator(const Sphere& sphere, const Light& light, float sigma_a, int num_steps)
+        : sphere(sphere), light(light), sigma_a(sigma_a), num_steps(num_steps) {}
 
-            Ray ray(camera, Vec3(px, py, -1).normalize());
+    Vec3 radiance(const CameraRay& camera_ray) const override {
+        const Ray& ray = camera_ray.ray;
+        float t0, t1;
+        if (!sphere.intersect(ray, t0, t1)) return BACKGROUND_COLOR;
+        return shade_sphere(ray.position(t0), ray.position(t1), sphere, light, sigma_a, num_steps);
+    }
 
-            float t0, t1;
-            Vec3 color = BACKGROUND_COLOR;
+    // The whole packet is marched in lockstep, one pixel per lane; short packets repeat their last ray
+    void radiancePacket(const CameraRay* camera_rays, int count, Vec3* out) const override {
+        Vec3x8 origin, direction;
+        for (int i = 0; i < PACKET_SIZE; ++i) {
+            const Ray& ray = camera_rays[std::min(i, count - 1)].ray;
+            origin.setLane(i, ray.origin);
+            direction.setLane(i, ray.direction);
+        }
 
-            if (sphere.intersect(ray, t0, t1)) {
-                Vec3 hit_point_entrance = ray.position(t0);
-                Vec3 hit_point_exit = ray.position(t1);
-                color = shade_sphere(hit_point_entrance, hit_point_exit, sphere, light, sigma_a, num_steps);
-            }
+        Vec3x8 oc = origin - Vec3x8(sphere.center);
+        float8 a = direction.dot(direction);
+        float8 b = 2.0f * oc.dot(direction);
+        float8 c = oc.dot(oc) - sphere.radius * sphere.radius;
+        float8 discriminant = b * b - 4.0f * a * c;
+        mask8 hit = greaterEqual8(discriminant, broadcast8(0.0f));
+
+        bool any_hit = false;
+        for (int i = 0; i < count; ++i) any_hit |= hit[i] != 0;
+        if (!any_hit) {
+            std::fill(out, out + count, BACKGROUND_COLOR);
+            return;
+        }
 
-            image[index] = static_cast<unsigned char>(std::min(color.x * 255.0f, 255.0f));
-            image[index + 1] = static_cast<unsigned char>(std::min(color.y * 255.0f, 255.0f));
-            image[index + 2] = static_cast<unsigned char>(std::min(color.z * 255.0f, 255.0f));
+        float8 root = sqrt8(max8(discriminant, broadcast8(0.0f)));
+        float8 inv2a = 0.5f / a;
+        Vec3x8 hit_point_entrance = origin + direction * ((-b - root) * inv2a);
+        Vec3x8 hit_point_exit = origin + direction * ((-b + root) * inv2a);
+        Vec3x8 color = shade_sphere8(hit_point_entrance, hit_point_exit, sphere, light, sigma_a, num_steps);
+
+        for (int i = 0; i < count; ++i) {
+            out[i] = hit[i] ? color.lane(i) : BACKGROUND_COLOR;
         }
     }
 
-    save_png("./results/forward_ray_marching.png", image.data(), width, height);
+private:
+    const Sphere& sphere;
+    const Light& light;
+    float sigma_a;
+    int num_steps;
+};
+
+void forward_ray_marching(int width, int height, float sigma_a, int num_steps) {
+    Film film(width, height);
+    Camera camera(Vec3(0.0f, 0.0f, 0.0f), width, height, float(M_PI) / 2.0f);
+    Material material(Vec3(0.0f), Vec3(1.0f), 0.1f, 0.9f, 0.5f, 1.0f, 0.0f, 32.0f, MaterialType::NONE);
+    Sphere sphere(Vec3(0.0f, 0.0f, -5.0f), 3.0f, material);
+    Light light(Vec3(4.0f, 4.0f, -7.0f), Vec3(1.3f, 0.3f, 0.9f), 10.0f);
+
+    renderImage(camera, ForwardMarchIntegrator(sphere, light, sigma_a, num_steps), film);
+
+    if (tileFarmRole() != FarmRole::Worker) film.save("./results/forward_ray_marching.png");
     std::cout << "Image saved as results/forward_ray_marching.png" << std::endl;
 }
 
 int main(int argc, char** argv) {
+    if (!setupTileFarm(argc, argv)) return 1;
+
     int width = 640;
     int height = 480;
     float sigma_a = 0.35f;
@@ -96,6 +174,8 @@ int main(int argc, char** argv) {
             sigma_a = std::stof(argv[++i]);
         } else if ((arg == "--steps" || arg == "-n") && i + 1 < argc) {
             num_steps = std::stoi(argv[++i]);
+        } else if ((arg == "--threads" || arg == "-t") && i + 1 < argc) {
+            TaskPool::setSharedThreadCount(static_cast<unsigned>(std::max(0, std::stoi(argv[++i]))));
         } else {
             std::cerr << "Unknown argument: " << arg << std::endl;
             std::exit(1);
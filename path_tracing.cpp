@@ -8,13 +8,15 @@
 #include <algorithm>
 #include <vector>
 #include <memory>
-#include <random>
 #include <cstring>
 #include "vec3.h"
 #include "material.h"
 #include "geometry.h"
 #include "optics.h"
 #include "primitive_tree.h"
+#include "renderer.h"
+#include "tile_farm.h"
+#include "random.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -23,9 +25,6 @@
 const Vec3 BACKGROUND_COLOR = Vec3(0.0f, 0.0f, 0.0f);
 const float EPSILON = 1e-4f;
 
-std::default_random_engine generator;
-std::uniform_real_distribution<float> distribution(0, 1);
-
 void create_coordinate_system(const Vec3& N, Vec3& N_t, Vec3& N_b){
     // Find the tagent vector
     if (std::abs(N.x) > std::abs(N.y)) N_t = Vec3(N.z, 0, -N.x);
@@ -50,7 +49,8 @@ Vec3 cast_ray(
     const std::vector<Light*>& lights,
     int depth,
     int max_bounces,
-    int num_samples
+    int num_samples,
+    SampleStream& random
 ){
     if (depth > max_bounces) return BACKGROUND_COLOR;
 
@@ -92,14 +92,18 @@ Vec3 cast_ray(
     Vec3 Nt, Nb;
     create_coordinate_system(N, Nt, Nb);
     for (int i = 0; i < num_samples; ++i) {
-        float r1 = distribution(generator);
-        float r2 = distribution(generator);
+        // The samples of the camera hit each draw their whole path from their own stream
+        SampleStream sample_random(random.getPixel(), static_cast<uint32_t>(i));
+        SampleStream& stream = depth == 0 ? sample_random : random;
+
+        float r1, r2;
+        stream.next2D(r1, r2);
         Vec3 samp = uniform_sample_hemisphere(r1, r2);
         Vec3 wi   = (Nb * samp.x + N * samp.y + Nt * samp.z).normalize();
         float cosTheta = std::max(0.0f, N.dot(wi));
 
         Ray indirect(hit_point + wi * EPSILON, wi);
-        Vec3 Li = cast_ray(indirect, primitives, lights, depth + 1, max_bounces, num_samples);
+        Vec3 Li = cast_ray(indirect, primitives, lights, depth + 1, max_bounces, num_samples, stream);
         Li_sum += Li * brdf * cosTheta / pdf_brdf;
     }
     Vec3 Li_indirect = Li_sum / float(num_samples);
@@ -114,11 +118,30 @@ Vec3 cast_ray(
     return L;
 }
 
+class PathIntegrator : public Integrator {
+public:
+    PathIntegrator(const PrimitiveTree& primitives, const std::vector<Light*>& lights, int max_bounces, int num_samples, int width)
+        : primitives(primitives), lights(lights), max_bounces(max_bounces), num_samples(num_samples), width(width) {}
 
-void path_tracing(int width, int height, int max_bounces, int num_samples, const std::string& output_path) {
-    unsigned char* image = new unsigned char[width * height * 3]();
+    Vec3 radiance(const CameraRay& camera_ray) const override {
+        // Every number the pixel draws is keyed by the pixel and sample, never by the thread or tile order.
+        // The camera hit draws nothing itself and starts one stream per sample.
+        SampleStream random(static_cast<uint32_t>(camera_ray.y * width + camera_ray.x), 0);
+        return cast_ray(camera_ray.ray, primitives, lights, 0, max_bounces, num_samples, random);
+    }
 
-    Vec3 camera(0.0f, 0.0f, 3.0f);
+private:
+    const PrimitiveTree& primitives;
+    const std::vector<Light*>& lights;
+    int max_bounces;
+    int num_samples;
+    int width;
+};
+
+
+void path_tracing(int width, int height, int max_bounces, int num_samples, const std::string& output_path) {
+    Film film(width, height);
+    Camera camera(Vec3(0.0f, 0.0f, 3.0f), width, height, float(M_PI) / 2.0f);
 
     std::vector<Primitive*> primitivesList;
 
@@ -161,21 +184,7 @@ void path_tracing(int width, int height, int max_bounces, int num_samples, const
     lights.push_back(new Light(Vec3(0.0f, 10.0f, 10.0f), Vec3(1.0f, 1.0f, 1.0f), 1000.0f));
     lights.push_back(new Light(Vec3(0.0f, 10.0f, -10.0f), Vec3(1.0f, 1.0f, 1.0f), 1000.0f));
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
-
-            float px = (2 * (x + 0.5f) / float(width) - 1) * width / float(height);
-            float py = (1 - 2 * (y + 0.5f) / float(height));
-
-            Ray ray(camera, Vec3(px, py, -1).normalize());
-            Vec3 color = cast_ray(ray, primitives, lights, 0, max_bounces, num_samples);
-
-            image[index] = static_cast<unsigned char>(std::min(color.x * 255.0f, 255.0f));
-            image[index + 1] = static_cast<unsigned char>(std::min(color.y * 255.0f, 255.0f));
-            image[index + 2] = static_cast<unsigned char>(std::min(color.z * 255.0f, 255.0f));
-        }
-    }
+    renderImage(camera, PathIntegrator(primitives, lights, max_bounces, num_samples, width), film);
 
     for (Primitive* primitive : primitivesList) {
         delete primitive;
@@ -185,13 +194,13 @@ void path_tracing(int width, int height, int max_bounces, int num_samples, const
         delete light;
     }
 
-    save_png(output_path.c_str(), image, width, height);
+    if (tileFarmRole() != FarmRole::Worker) film.save(output_path);
     std::cout << "Image saved as " << output_path.c_str() << std::endl;
-
-    delete[] image;
 }
 
 int main(int argc, char* argv[]) {
+    if (!setupTileFarm(argc, argv)) return 1;
+
     int width = 1280;
     int height = 1024;
     int max_bounces = 2;
@@ -210,13 +219,17 @@ int main(int argc, char* argv[]) {
                 num_samples = std::stoi(argv[++i]);
             } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
                 output_path = argv[++i];
+            } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                TaskPool::setSharedThreadCount(static_cast<unsigned>(std::max(0, std::stoi(argv[++i]))));
             } else if (strcmp(argv[i], "--help") == 0) {
-                std::cout << "Usage: " << argv[0] << " [--width W] [--height H] [--max-bounces M] [--num-samples N] [--output PATH]\n"
+                std::cout << "Usage: " << argv[0] << " [--width W] [--height H] [--max-bounces M] [--num-samples N] [--output PATH] [--threads N] [--farm N]\n"
                           << "  --width       Image width in pixels (default: 1280)\n"
                           << "  --height      Image height in pixels (default: 1024)\n"
                           << "  --max-bounces Maximum number of ray bounces (default: 2)\n"
                           << "  --num-samples Number of samples per pixel (default: 100)\n"
-                          << "  --output      Output file path (default: ./results/path_tracing.png)\n";
+                          << "  --output      Output file path (default: ./results/path_tracing.png)\n"
+                          << "  --threads     Render threads (default: one per hardware thread)\n"
+                          << "  --farm        Split the frame between N worker processes (--farm-timeout S reassigns silent ones)\n";
                 return 0;
             } else {
                 std::cerr << "Unknown or incomplete argument: " << argv[i] << "\n";
@@ -6,34 +6,140 @@
 #include <vector>
 #include <limits>
 #include <cstring>
+#include <cstdio>
 #include <cstdlib>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <random>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <sys/stat.h>
 
 #include "vec3.h"
+#include "utils.h"
 #include "mesh.h"
+#include "texture_cache.h"
 #include "geometry.h"
 #include "primitive_tree.h"
+#include "mesh_pages.h"
+#include "mesh_stream.h"
+#include "instance.h"
 #include "optics.h"
 #include "material.h"
+#include "timeline.h"
+#include "tile_scheduler.h"
+#include "renderer.h"
+#include "tile_farm.h"
+#include "numa.h"
+#include "perf_counter.h"
+#include "render_server.h"
+#include "resident_scenes.h"
+#include "camera_batch.h"
 
 const Vec3 BACKGROUND_COLOR(0.1f, 0.1f, 0.1f);
+const Vec3 CAMERA_POSITION(0.0f, 0.5f, 1.0f);
+const Vec3 CAMERA_TARGET(0.0f, 0.5f, 0.0f);
+const float FIELD_OF_VIEW = 90.0f * M_PI / 180.0f;
+const float LOD_REDUCTION = 0.25f;          // Triangle ratio between consecutive levels of detail
+const float LOD_TRIANGLES_PER_PIXEL = 2.0f;  // Detail kept per covered pixel when picking a level
+const size_t STREAM_BATCH_TRIANGLES = 1 << 16;  // Triangles per bottom-level tree when streaming
+const size_t STREAM_QUEUE_DEPTH = 8;            // Parsed batches allowed to wait for a tree builder
 
-Vec3 cast_ray(const Ray& ray, const Mesh& mesh, const PrimitiveTree& primitives, const std::vector<Light*>& lights) {
+enum class NumaPlacement {
+    Off,            // Workers float, one scene wherever it was built
+    Pin,            // Workers pinned and grouped by node, one scene
+    Replicate,      // Pinned, with the scene built again on every node
+    Interleave      // Pinned, with one scene whose pages are spread over all nodes
+};
+
+// What main() parsed for a render: the image, the scene and how the scene is held while it is traced
+struct RenderOptions {
+    int width = 1280;
+    int height = 1040;
+    std::string output_path = "./results/barrel.png";
+    std::string mesh_path = "./models/barrel.obj";
+    std::string texture_path = "./models/barrel.png";
+    SceneLoadOptions scene;             // Texture size, filtering and cache, triangle storage and welding
+    bool stream_mesh = false;
+    std::string pages_path;
+    int resident_levels = 12;
+    int crowd_size = 0;
+    int lod_levels = 4;
+    std::string lod_cache;
+    NumaPlacement numa_placement = NumaPlacement::Off;
+    TileOrder tile_order;
+    bool order_benchmark = false;
+    CameraBatch camera_batch;
+};
+
+// Triangles of an out-of-core page file, all sharing one material
+struct PagedScene {
+    const PagedMesh& pages;
+    const Material& material;
+};
+
+// The tree hands back pointers into its own primitive list
+bool intersect_scene(const PrimitiveTree& primitives, const Ray& ray, float& t, Primitive*& hit_primitive, std::optional<Triangle>& storage) {
+    return primitives.intersect(ray, t, hit_primitive);
+}
+
+// Paged triangles are decoded into caller-owned storage
+bool intersect_scene(const PagedScene& scene, const Ray& ray, float& t, Primitive*& hit_primitive, std::optional<Triangle>& storage) {
+    if (!scene.pages.intersect(ray, t, storage, scene.material)) return false;
+    hit_primitive = &*storage;
+    return true;
+}
+
+// One copy of the tree and its triangles per NUMA node; every render thread reads the copy on its own node
+struct ReplicatedScene {
+    std::vector<const PrimitiveTree*> trees;
+};
+
+bool intersect_scene(const ReplicatedScene& scene, const Ray& ray, float& t, Primitive*& hit_primitive, std::optional<Triangle>& storage) {
+    return intersect_scene(*scene.trees[TaskPool::currentNode()], ray, t, hit_primitive, storage);
+}
+
+// Top-level tree over mesh instances
+struct InstancedScene {
+    const PrimitiveTree& instances;
+};
+
+// The closest instance is intersected once more for its triangle, which is moved into caller-owned storage
+bool intersect_scene(const InstancedScene& scene, const Ray& ray, float& t, Primitive*& hit_primitive, std::optional<Triangle>& storage) {
+    if (!scene.instances.intersect(ray, t, hit_primitive)) return false;
+    const MeshInstance* instance = static_cast<MeshInstance*>(hit_primitive);
+    const Triangle* triangle;
+    if (!instance->intersect(ray, t, triangle)) return false;
+    storage.emplace(instance->getWorldTriangle(*triangle));
+    hit_primitive = &*storage;
+    return true;
+}
+
+template <typename Scene>
+Vec3 cast_ray(const Ray& ray, const Mesh& mesh, const Scene& primitives, const std::vector<Light*>& lights, const RayDifferential* differential = nullptr) {
     float t;
     Primitive* hit_primitive;
+    std::optional<Triangle> hit_storage;
 
-    if (!primitives.intersect(ray, t, hit_primitive)) {
+    if (!intersect_scene(primitives, ray, t, hit_primitive, hit_storage)) {
         return BACKGROUND_COLOR;
     }
 
     Vec3 hit_point = ray.position(t);
-    hit_primitive->setHitPoint(hit_point);
-    
+
     Vec3 shading_normal = hit_primitive->getNormal(hit_point);
     Triangle* triangle = dynamic_cast<Triangle*>(hit_primitive);
+    CompactTriangle* compact_triangle = dynamic_cast<CompactTriangle*>(hit_primitive);
     Vec3 geometric_normal;
 
     if (triangle) {
         geometric_normal = triangle->getFaceNormal();
+    } else if (compact_triangle) {
+        geometric_normal = compact_triangle->getFaceNormal();
     } else {
         geometric_normal = shading_normal;
     }
@@ -46,11 +152,28 @@ Vec3 cast_ray(const Ray& ray, const Mesh& mesh, const PrimitiveTree& primitives,
     }
 
     Vec3 base_color;
-    if (triangle) {
-        Vec3 texture_coordinate = hit_primitive->getTextureCoordinates();
+    if (triangle || compact_triangle) {
+        Vec3 texture_coordinate = hit_primitive->getTextureCoordinates(hit_point);
         float u = texture_coordinate[0];
         float v = texture_coordinate[1];
-        base_color = mesh.getColorAtUV(u, v);
+
+        // Carry the differentials to the surface (Igehy 1999) and turn the footprint into a mip level
+        float lod = 0.0f;
+        if (differential) {
+            float cos_incidence = ray.direction.dot(geometric_normal);
+            if (std::abs(cos_incidence) > 1e-6f) {
+                Vec3 dpdx = differential->ddx * t - ray.direction * (t * differential->ddx.dot(geometric_normal) / cos_incidence);
+                Vec3 dpdy = differential->ddy * t - ray.direction * (t * differential->ddy.dot(geometric_normal) / cos_incidence);
+                Vec3 duvdx, duvdy;
+                if (triangle) {
+                    triangle->getTextureDerivatives(dpdx, dpdy, duvdx, duvdy);
+                } else {
+                    compact_triangle->getTextureDerivatives(dpdx, dpdy, duvdx, duvdy);
+                }
+                lod = mesh.getTextureLevelOfDetail(duvdx, duvdy);
+            }
+        }
+        base_color = mesh.getColorAtUV(u, v, lod);
     } else {
         base_color = hit_primitive->material.color;
     }
@@ -67,8 +190,9 @@ Vec3 cast_ray(const Ray& ray, const Mesh& mesh, const PrimitiveTree& primitives,
         Ray shadow_ray(hit_point + geometric_normal * 1e-4, light_direction);
         float tShadow;
         Primitive* shadow_hit_primitive;
+        std::optional<Triangle> shadow_storage;
         
-        bool isInShadow = primitives.intersect(shadow_ray, tShadow, shadow_hit_primitive) && tShadow < light_distance;
+        bool isInShadow = intersect_scene(primitives, shadow_ray, tShadow, shadow_hit_primitive, shadow_storage) && tShadow < light_distance;
         
         if (!isInShadow && geometric_normal.dot(light_direction) > 0) {
             // Diffuse term
@@ -90,90 +214,521 @@ Vec3 cast_ray(const Ray& ray, const Mesh& mesh, const PrimitiveTree& primitives,
     return final_color;
 }
 
-void render(int width, int height, const std::string& output_path, const std::string& mesh_path, const std::string& texture_path, int texture_width, int texture_height) {
-    unsigned char* image = new unsigned char[width * height * 3]();
+// Blinn-Phong shading of a textured mesh, with the mip level picked from the camera ray differentials
+template <typename Scene>
+class BlinnPhongIntegrator : public Integrator {
+public:
+    BlinnPhongIntegrator(const Mesh& mesh, const Scene& primitives, const std::vector<Light*>& lights)
+        : mesh(mesh), primitives(primitives), lights(lights) {}
+
+    Vec3 radiance(const CameraRay& camera_ray) const override {
+        return cast_ray(camera_ray.ray, mesh, primitives, lights, &camera_ray.differential);
+    }
+
+private:
+    const Mesh& mesh;
+    const Scene& primitives;
+    const std::vector<Light*>& lights;
+};
+
+// Shading normals mapped to colors, a quick look at the geometry without texturing or shadows
+template <typename Scene>
+class NormalIntegrator : public Integrator {
+public:
+    explicit NormalIntegrator(const Scene& primitives) : primitives(primitives) {}
+
+    Vec3 radiance(const CameraRay& camera_ray) const override {
+        float t;
+        Primitive* hit_primitive;
+        std::optional<Triangle> hit_storage;
+        if (!intersect_scene(primitives, camera_ray.ray, t, hit_primitive, hit_storage)) {
+            return BACKGROUND_COLOR;
+        }
+        Vec3 normal = hit_primitive->getNormal(camera_ray.ray.position(t));
+        if (normal.dot(camera_ray.ray.direction) > 0.0f) normal = -normal;
+        return normal * 0.5f + Vec3(0.5f);
+    }
+
+private:
+    const Scene& primitives;
+};
+
+template <typename Scene>
+void trace_image(Film& film, const Mesh& mesh, const Scene& primitives, const std::vector<Light*>& lights, const TileOrder& tile_order, TaskPool& pool = TaskPool::shared()) {
+    Camera camera = Camera::lookAt(CAMERA_POSITION, CAMERA_TARGET, film.getWidth(), film.getHeight(), FIELD_OF_VIEW);
+    renderImage(camera, BlinnPhongIntegrator<Scene>(mesh, primitives, lights), film, pool, tile_order);
+}
 
+bool render_paged(Film& film, const RenderOptions& options, const Material& material, const std::vector<Light*>& lights) {
+    const std::string& pages_path = options.pages_path;
+    const std::string& mesh_path = options.mesh_path;
     Mesh mesh;
-    std::vector<float> vertex_array;
-    if (mesh.load(mesh_path, texture_path, texture_width, texture_height)){
-        vertex_array = mesh.getVertexArray();
-        std::cout << "Texture loaded successfully!" << std::endl;
-    } else {
-        std::cerr << "Failed to load " + mesh_path + " or texture!" << std::endl;
-        return;
+    mesh.setMipFilter(options.scene.mip_filter);
+    mesh.setTextureLayout(options.scene.texture_layout);
+    mesh.setTextureCache(options.scene.texture_cache);
+
+    Timeline timeline;
+    std::future<bool> texture_loaded = std::async(std::launch::async, [&]() {
+        return timeline.stage("texture", [&]() { return mesh.loadTexture(options.texture_path, options.scene.texture_width, options.scene.texture_height); });
+    });
+
+    struct stat st;
+    bool exists = stat(pages_path.c_str(), &st) == 0;
+    if (!exists || !PagedMesh::isCurrent(pages_path, mesh_path)) {
+        // First use, or the mesh changed: convert the OBJ, which is never loaded whole
+        if (exists) std::cout << "Page file " << pages_path << " is out of date, rebuilding from " << mesh_path << std::endl;
+        bool built = timeline.stage("page file", [&]() { return PagedMesh::build(pages_path, mesh_path, options.resident_levels); });
+        if (!built) {
+            texture_loaded.wait();
+            return false;
+        }
+        std::cout << "Page file written to " << pages_path << std::endl;
     }
 
-    if (vertex_array.empty()) {
-        std::cerr << "Failed to load " + mesh_path + "!" << std::endl;
-        return;
+    PagedMesh pages;
+    bool opened = timeline.stage("open pages", [&]() { return pages.open(pages_path); });
+    if (!timeline.stage("texture wait", [&]() { return texture_loaded.get(); }) || !opened) {
+        return false;
+    }
+    std::cout << "Paged triangles: " << pages.getTriangleCount() << " (" << pages.getResidentNodeCount() << " resident nodes)" << std::endl;
+    pages.printStats("open");
+
+    std::cout << "Assets ready, first ray after " << timeline.elapsed() * 1000.0 << " ms" << std::endl;
+    timeline.print(std::cout);
+    trace_image(film, mesh, PagedScene{pages, material}, lights, options.tile_order);
+
+    pages.printStats("render");
+    return true;
+}
+
+// Parses the OBJ while worker threads build one bottom-level tree per batch, then joins the trees
+bool render_streamed(Film& film, const RenderOptions& options, const Material& material, const std::vector<Light*>& lights) {
+    // Owns its primitives until they are handed to the top-level tree, so none leak if streaming stops early
+    struct ChunkTree {
+        size_t index = 0;
+        std::vector<Primitive*> primitives;
+        std::shared_ptr<PrimitiveNode> root;
+
+        explicit ChunkTree(size_t index) : index(index) {}
+        ChunkTree(ChunkTree&& other) noexcept { *this = std::move(other); }
+        ChunkTree& operator=(ChunkTree&& other) noexcept {
+            std::swap(index, other.index);
+            primitives.swap(other.primitives);
+            root.swap(other.root);
+            return *this;
+        }
+        ~ChunkTree() {
+            for (Primitive* primitive : primitives) {
+                delete primitive;
+            }
+        }
+    };
+
+    Mesh mesh;
+    mesh.setMipFilter(options.scene.mip_filter);
+    mesh.setTextureLayout(options.scene.texture_layout);
+    mesh.setTextureCache(options.scene.texture_cache);
+
+    Timeline timeline;
+    std::future<bool> texture_loaded = std::async(std::launch::async, [&]() {
+        return timeline.stage("texture", [&]() { return mesh.loadTexture(options.texture_path, options.scene.texture_width, options.scene.texture_height); });
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::mutex chunks_mutex;
+    std::vector<ChunkTree> chunks;
+    StreamStats stats;
+    bool streamed = timeline.stage("stream", [&]() { return streamObjTriangles(options.mesh_path, STREAM_BATCH_TRIANGLES, 0, STREAM_QUEUE_DEPTH, [&](TriangleBatch& batch) {
+        ChunkTree chunk(batch.index);
+        chunk.primitives.reserve(batch.triangles.size());
+        for (const MeshTriangle& triangle : batch.triangles) {
+            chunk.primitives.push_back(makeTriangle(triangle, material, nullptr));
+        }
+        chunk.root = PrimitiveTree(chunk.primitives).root;
+
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        chunks.push_back(std::move(chunk));
+    }, stats); });
+    if (!streamed) {
+        texture_loaded.wait();
+        return false;
     }
 
+    std::sort(chunks.begin(), chunks.end(), [](const ChunkTree& a, const ChunkTree& b) { return a.index < b.index; });
     std::vector<Primitive*> primitive_pointers;
+    primitive_pointers.reserve(stats.triangles);
+    std::vector<std::shared_ptr<PrimitiveNode>> roots;
+    std::vector<size_t> offsets;
+    for (ChunkTree& chunk : chunks) {
+        offsets.push_back(primitive_pointers.size());
+        roots.push_back(chunk.root);
+        primitive_pointers.insert(primitive_pointers.end(), chunk.primitives.begin(), chunk.primitives.end());
+        std::vector<Primitive*>().swap(chunk.primitives);
+    }
+    offsets.push_back(primitive_pointers.size());
+    PrimitiveTree primitives = timeline.stage("top-level tree", [&]() { return PrimitiveTree(primitive_pointers, roots, offsets); });
+
+    double ready_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = stats.bytes / (1024.0 * 1024.0);
+    std::cout << "Streamed " << megabytes << " MB into " << stats.triangles << " triangles in " << stats.batches << " chunk trees: "
+              << "parsed in " << stats.parse_seconds * 1000.0 << " ms, trees ready after " << ready_seconds * 1000.0 << " ms" << std::endl;
+
+    bool textured = timeline.stage("texture wait", [&]() { return texture_loaded.get(); });
+    if (textured) {
+        std::cout << "Assets ready, first ray after " << timeline.elapsed() * 1000.0 << " ms" << std::endl;
+        timeline.print(std::cout);
+        trace_image(film, mesh, primitives, lights, options.tile_order);
+    }
+
+    for (Primitive* primitive : primitive_pointers) {
+        delete primitive;
+    }
+    return textured;
+}
 
-    Vec3 primitive_color(1.0f, 0.0f, 0.0f);
-    Material material(primitive_color, 0.8f, 0.2f, 0.3f, 16.0f);
-
-    for (size_t i = 0; i < vertex_array.size(); i += 24) {
-        Vec3 v0(vertex_array[i], vertex_array[i+1], vertex_array[i+2]);
-        Vec3 v1(vertex_array[i+8], vertex_array[i+9], vertex_array[i+10]);
-        Vec3 v2(vertex_array[i+16], vertex_array[i+17], vertex_array[i+18]);
-        Vec3 n0 = Vec3(vertex_array[i+5], vertex_array[i+6], vertex_array[i+7]).normalize();
-        Vec3 n1 = Vec3(vertex_array[i+13], vertex_array[i+14], vertex_array[i+15]).normalize();
-        Vec3 n2 = Vec3(vertex_array[i+21], vertex_array[i+22], vertex_array[i+23]).normalize();
-        Vec3 st0(vertex_array[i+3], vertex_array[i+4], 0.0f);
-        Vec3 st1(vertex_array[i+11], vertex_array[i+12], 0.0f);
-        Vec3 st2(vertex_array[i+19], vertex_array[i+20], 0.0f);
-        primitive_pointers.push_back(new Triangle(v0, v1, v2, n0, n1, n2, st0, st1, st2, material));
-    }
-
-    PrimitiveTree primitives(primitive_pointers);
-    
-    Vec3 camera(0.0f, 0.5, 1.0f);
-    std::vector<Light*> lights;
-    lights.push_back(new Light(Vec3(0.0f, 1.0f, 1.5f), Vec3(1.0f, 1.0f, 1.0f), 1.0f));
-
-    float fov = 90.0f * M_PI / 180.0f;
+// Pixels covered by a sphere of the given radius seen from the camera
+float projected_pixels(const Vec3& center, float radius, int width, int height) {
+    float distance = std::max((center - CAMERA_POSITION).length(), radius);
     float aspect = float(width) / float(height);
+    float pixel_size = 2.0f * tan(FIELD_OF_VIEW / 2.0f) * aspect / float(width);
+    float radius_pixels = radius / distance / pixel_size;
+    return float(M_PI) * radius_pixels * radius_pixels;
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
+// Coarsest level that still has enough triangles for the instance's footprint
+int select_level(const Mesh& mesh, float covered_pixels) {
+    int level = 0;
+    while (level + 1 < mesh.getLevelCount()
+           && mesh.getTriangleCount(level + 1) >= covered_pixels * LOD_TRIANGLES_PER_PIXEL) {
+        ++level;
+    }
+    return level;
+}
+
+// A grid of instances receding from the camera; each traces the level of detail matching its size on screen
+bool render_crowd(Film& film, const RenderOptions& options, const Material& material, const std::vector<Light*>& lights) {
+    int crowd_size = options.crowd_size;
+    Mesh mesh;
+    mesh.setMipFilter(options.scene.mip_filter);
+    mesh.setTextureLayout(options.scene.texture_layout);
+    mesh.setTextureCache(options.scene.texture_cache);
+    mesh.setCacheEnabled(options.scene.mesh_cache);
+
+    Timeline timeline;
+    std::future<bool> texture_loaded = std::async(std::launch::async, [&]() {
+        return timeline.stage("texture", [&]() { return mesh.loadTexture(options.texture_path, options.scene.texture_width, options.scene.texture_height); });
+    });
+    if (!timeline.stage("geometry", [&]() { return mesh.loadGeometry(options.mesh_path); })) {
+        texture_loaded.wait();
+        std::cerr << "Failed to load " + options.mesh_path + "!" << std::endl;
+        return false;
+    }
+    timeline.stage("levels of detail", [&]() { mesh.generateLODs(options.lod_levels, LOD_REDUCTION, options.lod_cache); });
 
-            float px = tan(fov / 2.0f) * (2 * (x + 0.5f) / float(width) - 1) * aspect;
-            float py = tan(fov / 2.0f) * (1 - 2 * (y + 0.5f) / float(width));
+    BoundingBox bounds = mesh.getBoundingBox();
+    Vec3 center = bounds.center();
+    float radius = (bounds.max - bounds.min).length() / 2.0f;
+    float scale = 0.5f / radius;
+    float spacing = 1.25f;
 
-            Ray ray(camera, Vec3(px, py, -1).normalize());
-            Vec3 color = cast_ray(ray, mesh, primitives, lights);
+    std::vector<Primitive*> instances;
+    std::vector<int> selected_levels;
+    std::vector<int> level_usage(mesh.getLevelCount(), 0);
+    size_t traced_triangles = 0;
+    for (int row = 0; row < crowd_size; ++row) {
+        for (int column = 0; column < crowd_size; ++column) {
+            Vec3 position((column - (crowd_size - 1) / 2.0f) * spacing, (center.y - bounds.min.y) * scale, -1.0f - row * spacing);
+            int level = select_level(mesh, projected_pixels(position, 0.5f, film.getWidth(), film.getHeight()));
+            selected_levels.push_back(level);
+            level_usage[level]++;
+            traced_triangles += mesh.getTriangleCount(level);
 
-            auto to_srgb = [](float c){ return powf(std::clamp(c, 0.0f, 1.0f), 1.0f/2.2f); };
-            image[index]   = (unsigned char)(to_srgb(color.x) * 255.0f);
-            image[index + 1] = (unsigned char)(to_srgb(color.y) * 255.0f);
-            image[index + 2] = (unsigned char)(to_srgb(color.z) * 255.0f);
+            instances.push_back(new MeshInstance(nullptr, bounds, position - center * scale, scale, material));
         }
     }
 
-    for (Primitive* primitive : primitive_pointers){
-        delete primitive;
+    // One bottom-level tree per level of detail in use
+    std::vector<std::vector<Primitive*>> level_primitives(mesh.getLevelCount());
+    std::vector<std::unique_ptr<PrimitiveTree>> level_trees(mesh.getLevelCount());
+    timeline.stage("tree build", [&]() {
+        for (int level = 0; level < mesh.getLevelCount(); ++level) {
+            if (level_usage[level] == 0) continue;
+            appendTriangles(mesh, level, material, nullptr, level_primitives[level]);
+            level_trees[level] = std::make_unique<PrimitiveTree>(level_primitives[level]);
+            std::cout << "LOD " << level << ": " << level_usage[level] << " instances" << std::endl;
+        }
+    });
+    for (size_t i = 0; i < instances.size(); ++i) {
+        static_cast<MeshInstance*>(instances[i])->tree = level_trees[selected_levels[i]].get();
     }
+    std::cout << "Crowd: " << instances.size() << " instances referencing " << traced_triangles << " triangles ("
+              << instances.size() * mesh.getTriangleCount(0) << " at full detail)" << std::endl;
 
-    for (Light* light : lights) {
-        delete light;
+    PrimitiveTree top_level(instances);
+    bool textured = timeline.stage("texture wait", [&]() { return texture_loaded.get(); });
+    if (textured) {
+        std::cout << "Assets ready, first ray after " << timeline.elapsed() * 1000.0 << " ms" << std::endl;
+        timeline.print(std::cout);
+        trace_image(film, mesh, InstancedScene{top_level}, lights, options.tile_order);
+    }
+
+    for (Primitive* instance : instances) {
+        delete instance;
+    }
+    for (auto& primitives : level_primitives) {
+        for (Primitive* primitive : primitives) {
+            delete primitive;
+        }
     }
+    return textured;
+}
+
+// Renders the image in every tile and pixel order on a fresh pool per run, so hardware counters see
+// all of its workers; reports primary rays per second and the cache misses of the fastest of a few runs
+template <typename Scene>
+void benchmark_orders(Film& film, const Mesh& mesh, const Scene& primitives, const std::vector<Light*>& lights, TextureCache* texture_cache) {
+    const int RUNS = 3;
+    const CurveOrder orders[] = {CurveOrder::Scanline, CurveOrder::Morton, CurveOrder::Hilbert};
+    unsigned threads = TaskPool::shared().getThreadCount();
+    bool pinned = TaskPool::shared().isPinned();
+    double rays = static_cast<double>(film.getWidth()) * film.getHeight();
 
-    save_png(output_path.c_str(), image, width, height);
-    std::cout << "Image saved as " << output_path << std::endl;
+    // Pages in the scene and the texture before the first timed run
+    trace_image(film, mesh, primitives, lights, TileOrder());
 
-    delete[] image;
+    std::cout << "Order benchmark, " << film.getWidth() << "x" << film.getHeight() << " on " << threads << " threads, best of " << RUNS << ":" << std::endl;
+    for (CurveOrder tiles : orders) {
+        for (CurveOrder pixels : orders) {
+            TileOrder order{tiles, pixels};
+            double best_seconds = 0.0;
+            uint64_t l1_misses = 0, llc_misses = 0;
+            size_t texture_misses = 0;
+            bool counted = false;
+            for (int run = 0; run < RUNS; ++run) {
+                size_t texture_misses_before = texture_cache ? texture_cache->getStats().misses : 0;
+                CacheMissCounter l1_counter(CacheEvent::L1DataReadMisses);
+                CacheMissCounter llc_counter(CacheEvent::LastLevelMisses);
+                double seconds;
+                {
+                    TaskPool pool(threads, pinned);
+                    auto start = std::chrono::steady_clock::now();
+                    trace_image(film, mesh, primitives, lights, order, pool);
+                    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+                if (run == 0 || seconds < best_seconds) {
+                    best_seconds = seconds;
+                    l1_misses = l1_counter.read();
+                    llc_misses = llc_counter.read();
+                    texture_misses = texture_cache ? texture_cache->getStats().misses - texture_misses_before : 0;
+                    counted = l1_counter.isAvailable() || llc_counter.isAvailable();
+                }
+            }
+
+            // Formatted apart, so the fixed notation does not carry over to later output
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(2)
+                 << "  tiles " << curveOrderName(tiles) << ", pixels " << curveOrderName(pixels) << ": "
+                 << best_seconds * 1000.0 << " ms, " << rays / best_seconds / 1e6 << " Mrays/s, ";
+            if (counted) {
+                line << l1_misses / rays << " L1D / " << llc_misses / rays << " LLC misses per ray";
+            } else {
+                line << "cache misses unavailable";
+            }
+            if (texture_cache) line << ", " << texture_misses << " texture tiles paged in";
+            std::cout << line.str() << std::endl;
+        }
+    }
+}
+
+// Tiles per node of the shared pool, and whether the triangles each node reads sit on its own memory;
+// a sample of the triangles is located page by page with move_pages()
+void print_numa_report(const std::vector<std::vector<Primitive*>>& node_primitives) {
+    const size_t SAMPLES = 4096;
+    std::vector<TaskPoolNodeStats> stats = TaskPool::shared().getNodeStats();
+    for (size_t node = 0; node < stats.size(); ++node) {
+        const std::vector<Primitive*>& primitives = node_primitives[node_primitives.size() > 1 ? node : 0];
+        std::vector<const void*> addresses;
+        size_t stride = std::max<size_t>(1, primitives.size() / SAMPLES);
+        for (size_t i = 0; i < primitives.size(); i += stride) addresses.push_back(primitives[i]);
+
+        size_t local = 0, remote = 0, unknown = 0;
+        for (int page_node : pageNodes(addresses)) {
+            if (page_node < 0) unknown++;
+            else if (page_node == static_cast<int>(node)) local++;
+            else remote++;
+        }
+        std::cout << "NUMA node " << node << ": " << stats[node].workers << " workers, " << stats[node].tasks << " tiles ("
+                  << stats[node].remote_steals << " stolen from other nodes); of the triangles it reads, " << local
+                  << " on local pages, " << remote << " on remote pages";
+        if (unknown > 0) std::cout << ", " << unknown << " unknown";
+        std::cout << " of " << addresses.size() << " sampled" << std::endl;
+    }
+}
+
+// Loads the whole mesh, builds its tree (one per NUMA node when replicating) and traces the image or the camera batch
+bool render(Film& film, const RenderOptions& options, const Material& material, const std::vector<Light*>& lights) {
+    const SceneLoadOptions& scene = options.scene;
+    const std::string& mesh_path = options.mesh_path;
+    const std::string& texture_path = options.texture_path;
+    const TileOrder& tile_order = options.tile_order;
+    NumaPlacement numa_placement = options.numa_placement;
+
+    Mesh mesh;
+    mesh.setMipFilter(scene.mip_filter);
+    mesh.setTextureLayout(scene.texture_layout);
+    mesh.setTextureCache(scene.texture_cache);
+    mesh.setCacheEnabled(scene.mesh_cache);
+
+    // The texture decodes on its own thread while the geometry is loaded and its tree built
+    Timeline timeline;
+    std::future<bool> texture_loaded = std::async(std::launch::async, [&]() {
+        return timeline.stage("texture", [&]() { return mesh.loadTexture(texture_path, scene.texture_width, scene.texture_height); });
+    });
+
+    bool geometry_loaded = timeline.stage("geometry", [&]() {
+        if (!mesh.loadGeometry(mesh_path)) return false;
+        if (scene.weld_vertices) mesh.weld();
+        return true;
+    });
+    if (!geometry_loaded || mesh.getTriangleCount(0) == 0) {
+        texture_loaded.wait();
+        std::cerr << "Failed to load " + mesh_path + "!" << std::endl;
+        return false;
+    }
+
+    BoundingBox mesh_bounds = mesh.getBoundingBox();
+    QuantizationFrame frame(mesh_bounds.min, mesh_bounds.max);
+
+    // Replicas are built by a thread on their node, so first touch puts their pages there
+    int copies = numa_placement == NumaPlacement::Replicate ? NumaTopology::get().getNodeCount() : 1;
+    std::vector<std::vector<Primitive*>> node_primitives(copies);
+    std::vector<std::unique_ptr<PrimitiveTree>> node_trees(copies);
+    auto place = [&](int node, const std::function<void()>& build) {
+        if (numa_placement == NumaPlacement::Replicate) {
+            runOnNode(node, build);
+        } else if (numa_placement == NumaPlacement::Interleave) {
+            InterleavedAllocation interleaved;
+            build();
+        } else {
+            build();
+        }
+    };
+
+    timeline.stage("triangles", [&]() {
+        for (int node = 0; node < copies; ++node) {
+            place(node, [&]() { appendTriangles(mesh, 0, material, scene.compact_attributes ? &frame : nullptr, node_primitives[node]); });
+        }
+    });
+
+    size_t triangle_size = scene.compact_attributes ? sizeof(CompactTriangle) : sizeof(Triangle);
+    std::cout << "Triangles: " << node_primitives[0].size() << " (" << triangle_size << " bytes each, "
+              << node_primitives[0].size() * triangle_size / (1024.0 * 1024.0) << " MB";
+    if (copies > 1) std::cout << ", one copy on each of " << copies << " NUMA nodes";
+    std::cout << ")" << std::endl;
+
+    timeline.stage("tree build", [&]() {
+        for (int node = 0; node < copies; ++node) {
+            place(node, [&]() { node_trees[node] = std::make_unique<PrimitiveTree>(node_primitives[node]); });
+        }
+    });
+
+    bool textured = timeline.stage("texture wait", [&]() { return texture_loaded.get(); });
+    if (textured) {
+        std::cout << "Texture loaded successfully!" << std::endl;
+        std::cout << "Assets ready, first ray after " << timeline.elapsed() * 1000.0 << " ms" << std::endl;
+        timeline.print(std::cout);
+        std::vector<CameraPose> poses = options.camera_batch.poses;
+        if (options.camera_batch.orbit_views > 0) poses = orbitPoses(options.camera_batch, mesh_bounds, film.getWidth(), film.getHeight(), FIELD_OF_VIEW);
+        if (copies > 1) {
+            ReplicatedScene replicas;
+            for (const auto& tree : node_trees) replicas.trees.push_back(tree.get());
+            if (options.order_benchmark) benchmark_orders(film, mesh, replicas, lights, scene.texture_cache);
+            if (poses.empty()) {
+                trace_image(film, mesh, replicas, lights, tile_order);
+            } else {
+                traceViews(film, BlinnPhongIntegrator<ReplicatedScene>(mesh, replicas, lights), poses, FIELD_OF_VIEW, tile_order, options.output_path);
+            }
+        } else {
+            if (options.order_benchmark) benchmark_orders(film, mesh, *node_trees[0], lights, scene.texture_cache);
+            if (poses.empty()) {
+                trace_image(film, mesh, *node_trees[0], lights, tile_order);
+            } else {
+                traceViews(film, BlinnPhongIntegrator<PrimitiveTree>(mesh, *node_trees[0], lights), poses, FIELD_OF_VIEW, tile_order, options.output_path);
+            }
+        }
+        if (numa_placement != NumaPlacement::Off) print_numa_report(node_primitives);
+    } else {
+        std::cerr << "Failed to load texture " + texture_path + "!" << std::endl;
+    }
+
+    for (auto& primitives : node_primitives) {
+        for (Primitive* primitive : primitives) {
+            delete primitive;
+        }
+    }
+    return textured;
+}
+
+// Times base-level lookups in every texture layout, on scattered UVs and on a scanline sweep
+bool benchmark_texture(const std::string& texture_path) {
+    const size_t SAMPLES = 1 << 22;
+    const int SWEEP_SIDE = 2048;
+    std::vector<float> random_u(SAMPLES), random_v(SAMPLES), sweep_u(SAMPLES), sweep_v(SAMPLES);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (size_t i = 0; i < SAMPLES; ++i) {
+        random_u[i] = uniform(generator);
+        random_v[i] = uniform(generator);
+        sweep_u[i] = static_cast<float>(i % SWEEP_SIDE) / SWEEP_SIDE;
+        sweep_v[i] = static_cast<float>(i / SWEEP_SIDE % SWEEP_SIDE) / SWEEP_SIDE;
+    }
+
+    const std::pair<TextureLayout, const char*> layouts[] = {
+        {TextureLayout::Linear, "linear"}, {TextureLayout::Tiled4, "tiled4"},
+        {TextureLayout::Tiled8, "tiled8"}, {TextureLayout::Morton, "morton"}};
+
+    for (const auto& [layout, name] : layouts) {
+        Texture texture;
+        if (!texture.load(texture_path, true, layout)) {
+            std::cerr << "Failed to load texture." << std::endl;
+            return false;
+        }
+
+        auto time_stream = [&](const std::vector<float>& u, const std::vector<float>& v) {
+            Vec3 out[4];
+            float checksum = 0.0f;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < SAMPLES; i += 4) {
+                texture.sample4(&u[i], &v[i], out);
+                checksum += out[0].x + out[1].y + out[2].z + out[3].x;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (checksum < 0.0f) std::cout << checksum;
+            return seconds * 1e9 / SAMPLES;
+        };
+
+        double random_ns = time_stream(random_u, random_v);
+        double sweep_ns = time_stream(sweep_u, sweep_v);
+        std::cout << name << ": " << random_ns << " ns/sample random, " << sweep_ns << " ns/sample coherent" << std::endl;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
-    int width = 1280;
-    int height = 1040;
-    std::string output_path = "./results/barrel.png";
-    std::string mesh_path = "./models/barrel.obj";
-    std::string texture_path = "./models/barrel.png";
-    int texture_width = 4096;
-    int texture_height = 4096;
+    if (!setupTileFarm(argc, argv)) return 1;
+
+    RenderOptions options;
+    size_t texture_cache_mb = 0;
+    bool texture_benchmark = false;
+    std::string convert_source;
+    std::string convert_output;
+    unsigned threads = 0;
+    std::string serve_path;
+    int max_scenes = 4;
+    std::string submit_path;
+    std::string job_options;            // key=value words of a --submit job
+    std::string stats_path;
+    std::string stop_path;
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--help") == 0) {
@@ -186,22 +741,171 @@ int main(int argc, char* argv[]) {
                       << "  --mesh <path>           Set the path to the .obj mesh file\n"
                       << "  --texture <path>        Set the path to the texture file\n"
                       << "  --tex-width <pixels>    Set the texture width (default: 4096)\n"
-                      << "  --tex-height <pixels>   Set the texture height (default: 4096)\n";
+                      << "  --tex-height <pixels>   Set the texture height (default: 4096)\n"
+                      << "  --threads <n>           Render threads (default: one per hardware thread)\n"
+                      << "  --farm <n>              Split the frame between n worker processes\n"
+                      << "  --farm-timeout <s>      Reassign the tiles of a farm worker silent for this long (default: 30)\n"
+                      << "  --numa <mode>           off, pin (workers pinned per NUMA node), replicate (plus a scene copy per node)\n"
+                      << "                          or interleave (plus scene pages spread over the nodes) (default: off)\n"
+                      << "  --tile-order <order>    Order tiles are handed out in: scanline, morton or hilbert (default: hilbert)\n"
+                      << "  --pixel-order <order>   Order of the pixels within a tile: scanline, morton or hilbert (default: hilbert)\n"
+                      << "  --order-bench           Time the render in every tile and pixel order first, with cache misses where the kernel allows\n"
+                      << "  --compact               Store quantized positions, octahedral normals and half-float UVs\n"
+                      << "  --weld                  Merge duplicated position/normal/UV tuples after loading\n"
+                      << "  --mesh-cache            Weld the .obj file once into <mesh>.rtmesh and map that on later runs\n"
+                      << "  --convert <obj> <out>   Write a binary mesh cache for an .obj file and exit\n"
+                      << "  --stream                Build per-chunk trees on worker threads while the .obj file is parsed\n"
+                      << "  --mip <filter>          Texture mip filtering: none, nearest or trilinear (default: trilinear)\n"
+                      << "  --texture-layout <l>    Texel order: linear, tiled4, tiled8 or morton (default: linear)\n"
+                      << "  --texture-cache <MB>    Page texture tiles in from <texture>.rttex under this memory budget\n"
+                      << "  --texture-bench         Time texture lookups in every layout and exit\n"
+                      << "  --pages <path>          Render out-of-core from a memory-mapped page file (built from --mesh if missing)\n"
+                      << "  --resident-levels <n>   Tree levels kept resident when building a page file (default: 12)\n"
+                      << "  --crowd <n>             Render an n x n grid of instances with per-instance level of detail\n"
+                      << "  --lod-levels <n>        Maximum number of levels of detail for --crowd (default: 4)\n"
+                      << "  --lod-cache <path>      Cache file for the generated levels of detail\n"
+                      << "  --poses <path>          Render one numbered image per camera pose in the file, one \"x y z tx ty tz\" per line\n"
+                      << "  --orbit <n>[,r[,e]]     Render n numbered views around the mesh at distance r (default: framing the mesh)\n"
+                      << "                          and e degrees of elevation (default: 15)\n"
+                      << "  --serve <socket>        Keep scenes loaded and render jobs sent to this Unix socket until stopped\n"
+                      << "  --max-scenes <n>        Scenes a server keeps loaded (default: 4)\n"
+                      << "  --submit <socket>       Have the server on this socket render the image instead, with:\n"
+                      << "    --camera <x,y,z>        Camera position (default: 0,0.5,1)\n"
+                      << "    --look-at <x,y,z>       Point the camera looks at (default: 0,0.5,0)\n"
+                      << "    --integrator <name>     phong or normals (default: phong)\n"
+                      << "    --spp <n>               Samples per pixel, rounded down to a square (default: 1)\n"
+                      << "    --priority <n>          Jobs with a higher priority are rendered first (default: 0)\n"
+                      << "  --server-stats <socket> Print the job, queue and latency counters of a server\n"
+                      << "  --server-stop <socket>  Have a server finish its queued jobs and exit\n";
             return 0;
         } else if (strcmp(argv[i], "--width") == 0) {
-            if (i + 1 < argc) { width = std::atoi(argv[++i]); }
+            if (i + 1 < argc) { options.width = std::atoi(argv[++i]); }
         } else if (strcmp(argv[i], "--height") == 0) {
-            if (i + 1 < argc) { height = std::atoi(argv[++i]); }
+            if (i + 1 < argc) { options.height = std::atoi(argv[++i]); }
         } else if (strcmp(argv[i], "--output") == 0) {
-            if (i + 1 < argc) { output_path = argv[++i]; }
+            if (i + 1 < argc) { options.output_path = argv[++i]; }
         } else if (strcmp(argv[i], "--mesh") == 0) {
-            if (i + 1 < argc) { mesh_path = argv[++i]; }
+            if (i + 1 < argc) { options.mesh_path = argv[++i]; }
         } else if (strcmp(argv[i], "--texture") == 0) {
-            if (i + 1 < argc) { texture_path = argv[++i]; }
+            if (i + 1 < argc) { options.texture_path = argv[++i]; }
         } else if (strcmp(argv[i], "--tex-width") == 0) {
-            if (i + 1 < argc) { texture_width = std::atoi(argv[++i]); }
+            if (i + 1 < argc) { options.scene.texture_width = std::atoi(argv[++i]); }
         } else if (strcmp(argv[i], "--tex-height") == 0) {
-            if (i + 1 < argc) { texture_height = std::atoi(argv[++i]); }
+            if (i + 1 < argc) { options.scene.texture_height = std::atoi(argv[++i]); }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 < argc) { threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i]))); }
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            if (i + 1 < argc) {
+                std::string mode = argv[++i];
+                if (mode == "off") {
+                    options.numa_placement = NumaPlacement::Off;
+                } else if (mode == "pin") {
+                    options.numa_placement = NumaPlacement::Pin;
+                } else if (mode == "replicate") {
+                    options.numa_placement = NumaPlacement::Replicate;
+                } else if (mode == "interleave") {
+                    options.numa_placement = NumaPlacement::Interleave;
+                } else {
+                    std::cerr << "Unknown NUMA mode: " << mode << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--tile-order") == 0 || strcmp(argv[i], "--pixel-order") == 0) {
+            if (i + 1 < argc) {
+                CurveOrder& order = strcmp(argv[i], "--tile-order") == 0 ? options.tile_order.tiles : options.tile_order.pixels;
+                std::string name = argv[++i];
+                if (!parseCurveOrder(name, order)) {
+                    std::cerr << "Unknown order: " << name << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--order-bench") == 0) {
+            options.order_benchmark = true;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.scene.compact_attributes = true;
+        } else if (strcmp(argv[i], "--weld") == 0) {
+            options.scene.weld_vertices = true;
+        } else if (strcmp(argv[i], "--mesh-cache") == 0) {
+            options.scene.mesh_cache = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            options.stream_mesh = true;
+        } else if (strcmp(argv[i], "--mip") == 0) {
+            if (i + 1 < argc) {
+                std::string filter = argv[++i];
+                if (filter == "none") {
+                    options.scene.mip_filter = MipFilter::None;
+                } else if (filter == "nearest") {
+                    options.scene.mip_filter = MipFilter::Nearest;
+                } else if (filter == "trilinear") {
+                    options.scene.mip_filter = MipFilter::Trilinear;
+                } else {
+                    std::cerr << "Unknown mip filter: " << filter << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--texture-layout") == 0) {
+            if (i + 1 < argc) {
+                std::string layout = argv[++i];
+                if (layout == "linear") {
+                    options.scene.texture_layout = TextureLayout::Linear;
+                } else if (layout == "tiled4") {
+                    options.scene.texture_layout = TextureLayout::Tiled4;
+                } else if (layout == "tiled8") {
+                    options.scene.texture_layout = TextureLayout::Tiled8;
+                } else if (layout == "morton") {
+                    options.scene.texture_layout = TextureLayout::Morton;
+                } else {
+                    std::cerr << "Unknown texture layout: " << layout << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--texture-cache") == 0) {
+            if (i + 1 < argc) { texture_cache_mb = static_cast<size_t>(std::max(0, std::atoi(argv[++i]))); }
+        } else if (strcmp(argv[i], "--texture-bench") == 0) {
+            texture_benchmark = true;
+        } else if (strcmp(argv[i], "--convert") == 0) {
+            if (i + 2 >= argc) {
+                std::cerr << "--convert needs an .obj file and an output path" << std::endl;
+                return 1;
+            }
+            convert_source = argv[++i];
+            convert_output = argv[++i];
+        } else if (strcmp(argv[i], "--pages") == 0) {
+            if (i + 1 < argc) { options.pages_path = argv[++i]; }
+        } else if (strcmp(argv[i], "--resident-levels") == 0) {
+            if (i + 1 < argc) { options.resident_levels = std::atoi(argv[++i]); }
+        } else if (strcmp(argv[i], "--crowd") == 0) {
+            if (i + 1 < argc) { options.crowd_size = std::atoi(argv[++i]); }
+        } else if (strcmp(argv[i], "--lod-levels") == 0) {
+            if (i + 1 < argc) { options.lod_levels = std::max(1, std::atoi(argv[++i])); }
+        } else if (strcmp(argv[i], "--lod-cache") == 0) {
+            if (i + 1 < argc) { options.lod_cache = argv[++i]; }
+        } else if (strcmp(argv[i], "--poses") == 0) {
+            if (i + 1 < argc && !loadCameraPoses(argv[++i], options.camera_batch.poses)) return 1;
+        } else if (strcmp(argv[i], "--orbit") == 0) {
+            if (i + 1 < argc) {
+                const char* spec = argv[++i];
+                if (std::sscanf(spec, "%d,%f,%f", &options.camera_batch.orbit_views, &options.camera_batch.orbit_radius, &options.camera_batch.orbit_elevation) < 1 || options.camera_batch.orbit_views < 1) {
+                    std::cerr << "Bad orbit: " << spec << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 < argc) { serve_path = argv[++i]; }
+        } else if (strcmp(argv[i], "--max-scenes") == 0) {
+            if (i + 1 < argc) { max_scenes = std::max(1, std::atoi(argv[++i])); }
+        } else if (strcmp(argv[i], "--submit") == 0) {
+            if (i + 1 < argc) { submit_path = argv[++i]; }
+        } else if (strcmp(argv[i], "--camera") == 0 || strcmp(argv[i], "--look-at") == 0 || strcmp(argv[i], "--integrator") == 0
+                   || strcmp(argv[i], "--spp") == 0 || strcmp(argv[i], "--priority") == 0) {
+            if (i + 1 < argc) {
+                const char* key = strcmp(argv[i], "--look-at") == 0 ? "target" : argv[i] + 2;
+                job_options += std::string(" ") + key + "=" + argv[++i];
+            }
+        } else if (strcmp(argv[i], "--server-stats") == 0) {
+            if (i + 1 < argc) { stats_path = argv[++i]; }
+        } else if (strcmp(argv[i], "--server-stop") == 0) {
+            if (i + 1 < argc) { stop_path = argv[++i]; }
         } else {
             std::cerr << "Unknown argument: " << argv[i] << std::endl;
             std::cerr << "Use --help for usage information." << std::endl;
@@ -209,13 +913,145 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    std::cout << "Rendering with the following settings:\n"
-              << "  Resolution: " << width << "x" << height << "\n"
-              << "  Output: " << output_path << "\n"
-              << "  Mesh: " << mesh_path << "\n"
-              << "  Texture: " << texture_path << " (" << texture_width << "x" << texture_height << ")\n";
+    // Tools that exit once done, run after the loop so they see every option
+    if (texture_benchmark) {
+        return benchmark_texture(options.texture_path) ? 0 : 1;
+    }
+    if (!convert_source.empty()) {
+        if (!Mesh::convert(convert_source, convert_output)) {
+            std::cerr << "Failed to convert " << convert_source << std::endl;
+            return 1;
+        }
+        std::cout << "Mesh cache written to " << convert_output << std::endl;
+        return 0;
+    }
+
+    bool server_mode = !serve_path.empty() || !submit_path.empty() || !stats_path.empty() || !stop_path.empty();
+    if (server_mode && tileFarmRole() != FarmRole::None) {
+        std::cerr << "--farm does not apply to render servers or their clients" << std::endl;
+        return 1;
+    }
+
+    std::string error;
+    if (!stop_path.empty()) {
+        if (!stopRenderServer(stop_path, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Render server at " << stop_path << " is stopping" << std::endl;
+        return 0;
+    }
+    if (!stats_path.empty()) {
+        std::string stats;
+        if (!requestServerStats(stats_path, stats, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << stats << std::endl;
+        return 0;
+    }
+    if (!submit_path.empty()) {
+        // Paths are resolved here, since the server may run in another directory
+        RenderJob job;
+        std::string line = "render mesh=" + absolute_path(options.mesh_path) + " texture=" + absolute_path(options.texture_path)
+                         + " width=" + std::to_string(options.width) + " height=" + std::to_string(options.height) + job_options;
+        if (!parseRenderJob(line, job, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        std::vector<unsigned char> pixels;
+        RenderJobReport report;
+        if (!submitRenderJob(submit_path, job, pixels, report, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::ostringstream summary;
+        summary << std::fixed << std::setprecision(1) << "Job " << report.id << ": " << report.queued_ahead << " queued ahead, waited "
+                << report.wait_ms << " ms, rendered in " << report.render_ms << " ms";
+        std::cout << summary.str() << std::endl;
+        save_png(options.output_path, pixels.data(), report.width, report.height);
+        std::cout << "Image saved as " << options.output_path << std::endl;
+        return 0;
+    }
+    if (!job_options.empty()) {
+        std::cout << "--camera, --look-at, --integrator, --spp and --priority only apply to --submit" << std::endl;
+    }
+
+    if (serve_path.empty()) {
+        std::cout << "Rendering with the following settings:\n"
+                  << "  Resolution: " << options.width << "x" << options.height << "\n"
+                  << "  Output: " << options.output_path << "\n";
+    } else {
+        std::cout << "Serving with the following settings:\n";
+    }
+    std::cout << "  Mesh: " << options.mesh_path << "\n"
+              << "  Texture: " << options.texture_path << " (" << options.scene.texture_width << "x" << options.scene.texture_height << ")\n";
+
+    TaskPool::setSharedThreadCount(threads);
+    TaskPool::setSharedPinning(options.numa_placement != NumaPlacement::Off);
+    std::cout << "  Threads: " << TaskPool::shared().getThreadCount();
+    if (TaskPool::shared().isPinned()) std::cout << " (pinned, " << NumaTopology::get().getNodeCount() << " NUMA nodes)";
+    std::cout << "\n"
+              << "  Order: " << curveOrderName(options.tile_order.tiles) << " tiles, " << curveOrderName(options.tile_order.pixels) << " pixels\n";
+
+    std::unique_ptr<TextureCache> texture_cache;
+    if (texture_cache_mb > 0) texture_cache.reset(new TextureCache(texture_cache_mb << 20));
+    options.scene.texture_cache = texture_cache.get();
+
+    Material material(Vec3(1.0f, 0.0f, 0.0f), 0.8f, 0.2f, 0.3f, 16.0f);
+    Light light(Vec3(0.0f, 1.0f, 1.5f), Vec3(1.0f, 1.0f, 1.0f), 1.0f);
+    std::vector<Light*> lights = {&light};
+
+    if (!serve_path.empty()) {
+        std::map<std::string, SceneIntegratorFactory> integrators = {
+            {"phong", [&](const ResidentScene& scene) -> std::unique_ptr<Integrator> {
+                return std::make_unique<BlinnPhongIntegrator<PrimitiveTree>>(scene.mesh, *scene.tree, lights);
+            }},
+            {"normals", [](const ResidentScene& scene) -> std::unique_ptr<Integrator> {
+                return std::make_unique<NormalIntegrator<PrimitiveTree>>(*scene.tree);
+            }}};
+        return serveResidentScenes(serve_path, max_scenes, options.mesh_path, options.texture_path, options.scene, material, integrators, FIELD_OF_VIEW, options.tile_order) ? 0 : 1;
+    }
+
+    // Crowds, page files and streamed meshes never hold the whole mesh at once
+    bool out_of_core = options.crowd_size > 0 || !options.pages_path.empty() || options.stream_mesh;
+    if (out_of_core) {
+        if (options.numa_placement == NumaPlacement::Replicate || options.numa_placement == NumaPlacement::Interleave) {
+            std::cout << "Scene replication and interleaving only apply to the in-memory mesh; workers are pinned only" << std::endl;
+        }
+        if (options.order_benchmark) {
+            std::cout << "The order benchmark only applies to the in-memory mesh; rendering once" << std::endl;
+        }
+        if (!options.camera_batch.empty()) {
+            std::cout << "Camera batches only apply to the in-memory mesh; rendering the default view" << std::endl;
+        }
+    }
+
+    Film film(options.width, options.height, FilmEncoding::Gamma22);
+    bool rendered;
+    if (options.crowd_size > 0) {
+        rendered = render_crowd(film, options, material, lights);
+    } else if (!options.pages_path.empty()) {
+        rendered = render_paged(film, options, material, lights);
+    } else if (options.stream_mesh) {
+        rendered = render_streamed(film, options, material, lights);
+    } else {
+        rendered = render(film, options, material, lights);
+    }
 
-    render(width, height, output_path, mesh_path, texture_path, texture_width, texture_height);
+    // A batch saved each view as it was traced
+    if (rendered && (out_of_core || options.camera_batch.empty()) && tileFarmRole() != FarmRole::Worker) {
+        film.save(options.output_path);
+        std::cout << "Image saved as " << options.output_path << std::endl;
+    }
+
+    if (texture_cache) {
+        TextureCacheStats stats = texture_cache->getStats();
+        std::cout << "Texture cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+                  << stats.hitRate() * 100.0 << "% hit rate), " << stats.evictions << " evictions, "
+                  << stats.resident_tiles << "/" << stats.capacity_tiles << " tiles resident" << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
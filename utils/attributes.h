@@ -0,0 +1,154 @@
+#ifndef ATTRIBUTES_H
+#define ATTRIBUTES_H
+
+/*
+ * Compact vertex attribute encodings
+ *
+ * - Normals: octahedral mapping stored as two 16-bit snorms (4 bytes).
+ * - Texture coordinates: two IEEE half floats (4 bytes).
+ * - Positions: three 16-bit unorms relative to a QuantizationFrame,
+ *   normally the bounding box of the whole mesh (6 bytes).
+ *
+ * Everything is inline so decoding folds into the intersection and
+ * shading code that calls it.
+ */
+
+#include "vec3.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+/*
+ * Half float
+ */
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (exponent <= 0) {
+        // Subnormal half or zero
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) half += 1;
+        return static_cast<uint16_t>(sign | half);
+    }
+    if (exponent >= 31) {
+        // Overflow, infinity or NaN
+        uint32_t nan = (((bits >> 23) & 0xffu) == 0xffu && mantissa) ? 0x200u : 0u;
+        return static_cast<uint16_t>(sign | 0x7c00u | nan);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) half += 1; // Round to nearest
+    return static_cast<uint16_t>(half);
+}
+
+inline float halfToFloat(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Renormalize the subnormal
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400u)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline uint32_t encodeHalf2(float u, float v) {
+    return static_cast<uint32_t>(floatToHalf(u)) | (static_cast<uint32_t>(floatToHalf(v)) << 16);
+}
+
+inline Vec3 decodeHalf2(uint32_t packed) {
+    return Vec3(halfToFloat(static_cast<uint16_t>(packed & 0xffffu)), halfToFloat(static_cast<uint16_t>(packed >> 16)), 0.0f);
+}
+
+/*
+ * Octahedral normal
+ */
+inline uint32_t encodeOctahedral(const Vec3& n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 <= 0.0f) return 0;
+
+    float x = n.x / l1;
+    float y = n.y / l1;
+    if (n.z < 0.0f) {
+        float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    auto snorm16 = [](float f) {
+        return static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(f, -1.0f, 1.0f) * 32767.0f)));
+    };
+    return static_cast<uint32_t>(snorm16(x)) | (static_cast<uint32_t>(snorm16(y)) << 16);
+}
+
+inline Vec3 decodeOctahedral(uint32_t packed) {
+    float x = static_cast<int16_t>(packed & 0xffffu) / 32767.0f;
+    float y = static_cast<int16_t>(packed >> 16) / 32767.0f;
+    float z = 1.0f - std::abs(x) - std::abs(y);
+
+    float t = std::max(-z, 0.0f);
+    x += (x >= 0.0f) ? -t : t;
+    y += (y >= 0.0f) ? -t : t;
+    return Vec3(x, y, z).normalize();
+}
+
+/*
+ * Position quantization
+ */
+class QuantizationFrame {
+public:
+    Vec3 origin;
+    Vec3 step;       // World-space size of one quantization step per axis
+
+    QuantizationFrame() : origin(0.0f), step(1.0f) {}
+
+    QuantizationFrame(const Vec3& min, const Vec3& max) : origin(min) {
+        Vec3 extent = max - min;
+        for (int i = 0; i < 3; ++i) {
+            step[i] = extent[i] > 0.0f ? extent[i] / 65535.0f : 1.0f;
+        }
+    }
+
+    std::array<uint16_t, 3> quantize(const Vec3& p) const {
+        std::array<uint16_t, 3> q;
+        for (int i = 0; i < 3; ++i) {
+            float f = std::round((p[i] - origin[i]) / step[i]);
+            q[i] = static_cast<uint16_t>(std::clamp(f, 0.0f, 65535.0f));
+        }
+        return q;
+    }
+
+    Vec3 dequantize(const std::array<uint16_t, 3>& q) const {
+        return origin + Vec3(q[0], q[1], q[2]) * step;
+    }
+};
+
+#endif // ATTRIBUTES_H
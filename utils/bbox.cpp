@@ -64,7 +64,7 @@ bool BoundingBox::intersect(const Ray& ray, float& t_min) const {
         t_min = std::max(t_min, t0);
         t_max = std::min(t_max, t1);
 
-        if (t_max <= t_min) return false;
+        if (t_max < t_min) return false;
     }
 
     return true;
@@ -84,7 +84,7 @@ bool BoundingBox::intersect(const Ray& ray, float& t_min, float& t_max) const {
         t_min = std::max(t_min, t0);
         t_max = std::min(t_max, t1);
 
-        if (t_max <= t_min) return false;
+        if (t_max < t_min) return false;
     }
 
     return true;
@@ -0,0 +1,92 @@
+#include "camera_batch.h"
+#include "tile_farm.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+bool loadCameraPoses(const std::string& path, std::vector<CameraPose>& poses) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open pose file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        std::istringstream values(line);
+        float p[6];
+        std::string rest;
+        if (!(values >> p[0] >> p[1] >> p[2] >> p[3] >> p[4] >> p[5]) || (values >> rest)) {
+            std::cerr << path << ":" << number << ": expected six numbers, a position and a target" << std::endl;
+            return false;
+        }
+        poses.push_back({Vec3(p[0], p[1], p[2]), Vec3(p[3], p[4], p[5])});
+    }
+    if (poses.empty()) {
+        std::cerr << "No poses in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<CameraPose> orbitPoses(const CameraBatch& batch, const BoundingBox& bounds, int width, int height, float fov) {
+    Vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = batch.orbit_radius;
+    if (radius <= 0.0f) {
+        // Distance at which the bounding sphere fits the narrower side of Camera::lookAt()'s frame
+        float aspect = float(width) / float(height);
+        float half_extent = std::tan(fov / 2.0f) * std::min(aspect, 1.0f / aspect);
+        radius = (bounds.max - bounds.min).length() * 0.5f / std::sin(std::atan(half_extent));
+    }
+
+    float elevation = batch.orbit_elevation * float(M_PI) / 180.0f;
+    std::vector<CameraPose> poses;
+    for (int i = 0; i < batch.orbit_views; ++i) {
+        float angle = 2.0f * float(M_PI) * i / batch.orbit_views;
+        Vec3 offset(std::cos(elevation) * std::sin(angle), std::sin(elevation), std::cos(elevation) * std::cos(angle));
+        poses.push_back({center + offset * radius, center});
+    }
+    return poses;
+}
+
+std::string numberedPath(const std::string& path, int index, int count) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+
+    int digits = std::max<int>(3, std::to_string(std::max(count - 1, 0)).size());
+    std::string number = std::to_string(index);
+    return path.substr(0, dot) + "_" + std::string(std::max<int>(0, digits - number.size()), '0') + number + path.substr(dot);
+}
+
+void traceViews(Film& film, const Integrator& integrator, const std::vector<CameraPose>& poses, float fov,
+                const TileOrder& tile_order, const std::string& output_path) {
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(1);
+
+    double total_ms = 0.0;
+    for (size_t i = 0; i < poses.size(); ++i) {
+        Camera camera = Camera::lookAt(poses[i].position, poses[i].target, film.getWidth(), film.getHeight(), fov);
+        auto start = std::chrono::steady_clock::now();
+        renderImage(camera, integrator, film, tile_order);
+        double trace_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        total_ms += trace_ms;
+
+        if (tileFarmRole() == FarmRole::Worker) continue;
+        std::string path = numberedPath(output_path, static_cast<int>(i), static_cast<int>(poses.size()));
+        film.save(path);
+        std::cout << "View " << i + 1 << "/" << poses.size() << " traced in " << trace_ms << " ms, saved as " << path << std::endl;
+    }
+    std::cout << poses.size() << " views traced in " << total_ms << " ms (" << total_ms / std::max<size_t>(poses.size(), 1) << " ms each)" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
@@ -0,0 +1,49 @@
+#ifndef CAMERA_BATCH_H
+#define CAMERA_BATCH_H
+
+/*
+ * Batches of camera views rendered from one scene load
+ *
+ * A batch is a list of poses read from a file or an orbit around the mesh.
+ * traceViews() traces each pose through one integrator, so the scene and
+ * its tree are loaded and built once for all the views, and saves every
+ * view to its own numbered copy of the output path.
+ */
+
+#include "vec3.h"
+#include "bbox.h"
+#include "renderer.h"
+#include "tile_scheduler.h"
+#include <string>
+#include <vector>
+
+struct CameraPose {
+    Vec3 position;
+    Vec3 target;
+};
+
+// The views of a batch render: poses read from a file, or an orbit around the mesh
+struct CameraBatch {
+    std::vector<CameraPose> poses;
+    int orbit_views = 0;
+    float orbit_radius = 0.0f;          // 0: just far enough to frame the whole mesh
+    float orbit_elevation = 15.0f;      // Degrees above the center of the mesh
+
+    bool empty() const { return poses.empty() && orbit_views == 0; }
+};
+
+// One pose per line, "x y z  tx ty tz" for the position and the point looked at; # starts a comment.
+// False with a message when the file cannot be read or holds no poses.
+bool loadCameraPoses(const std::string& path, std::vector<CameraPose>& poses);
+
+// The orbit of `batch`: evenly spaced around the vertical axis through the center of `bounds`, the first view from +z
+std::vector<CameraPose> orbitPoses(const CameraBatch& batch, const BoundingBox& bounds, int width, int height, float fov);
+
+// results/barrel.png -> results/barrel_007.png, with at least three digits and enough for `count` paths
+std::string numberedPath(const std::string& path, int index, int count);
+
+// Traces every pose with Camera::lookAt() into `film`, saving each view to its numbered output
+void traceViews(Film& film, const Integrator& integrator, const std::vector<CameraPose>& poses, float fov,
+                const TileOrder& tile_order, const std::string& output_path);
+
+#endif // CAMERA_BATCH_H
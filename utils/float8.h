@@ -0,0 +1,165 @@
+#ifndef FLOAT8_H
+#define FLOAT8_H
+
+/*
+ * 8-lane float vectors
+ *
+ * One lane per pixel of a packet, through GCC vector extensions like Vec3.
+ * Building with AVX2=1 (make AVX2=1) lowers every operation to a single
+ * 256-bit AVX instruction; otherwise the compiler splits them into pairs of
+ * SSE instructions. Comparisons give mask8 lanes of all ones or all zeros,
+ * to be used with select().
+ */
+
+#include "vec3.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+typedef float float8 __attribute__((vector_size(32)));
+typedef int32_t mask8 __attribute__((vector_size(32)));
+
+inline float8 broadcast8(float value) {
+    return float8{value, value, value, value, value, value, value, value};
+}
+
+// Comparisons, min, max and sqrt go through intrinsics: without AVX, GCC turns the generic
+// 32-byte versions into scalar code instead of pairs of SSE instructions
+union Float8Bits {
+    float8 lanes;
+    mask8 mask;
+#if defined(__AVX__)
+    __m256 avx;
+#elif defined(__SSE__)
+    __m128 sse[2];
+#endif
+};
+
+inline float8 select(mask8 mask, float8 a, float8 b) {
+    Float8Bits x{a}, y{b};
+    x.mask = (mask & x.mask) | (~mask & y.mask);
+    return x.lanes;
+}
+
+inline float8 min8(float8 a, float8 b) {
+    Float8Bits x{a}, y{b};
+#if defined(__AVX__)
+    x.avx = _mm256_min_ps(x.avx, y.avx);
+#elif defined(__SSE__)
+    x.sse[0] = _mm_min_ps(x.sse[0], y.sse[0]);
+    x.sse[1] = _mm_min_ps(x.sse[1], y.sse[1]);
+#else
+    for (int i = 0; i < 8; ++i) x.lanes[i] = std::min(a[i], b[i]);
+#endif
+    return x.lanes;
+}
+
+inline float8 max8(float8 a, float8 b) {
+    Float8Bits x{a}, y{b};
+#if defined(__AVX__)
+    x.avx = _mm256_max_ps(x.avx, y.avx);
+#elif defined(__SSE__)
+    x.sse[0] = _mm_max_ps(x.sse[0], y.sse[0]);
+    x.sse[1] = _mm_max_ps(x.sse[1], y.sse[1]);
+#else
+    for (int i = 0; i < 8; ++i) x.lanes[i] = std::max(a[i], b[i]);
+#endif
+    return x.lanes;
+}
+
+// a < b in every lane
+inline mask8 less8(float8 a, float8 b) {
+    Float8Bits x{a}, y{b};
+#if defined(__AVX__)
+    x.avx = _mm256_cmp_ps(x.avx, y.avx, _CMP_LT_OQ);
+#elif defined(__SSE__)
+    x.sse[0] = _mm_cmplt_ps(x.sse[0], y.sse[0]);
+    x.sse[1] = _mm_cmplt_ps(x.sse[1], y.sse[1]);
+#else
+    for (int i = 0; i < 8; ++i) x.mask[i] = a[i] < b[i] ? -1 : 0;
+#endif
+    return x.mask;
+}
+
+// a >= b in every lane
+inline mask8 greaterEqual8(float8 a, float8 b) {
+    Float8Bits x{a}, y{b};
+#if defined(__AVX__)
+    x.avx = _mm256_cmp_ps(x.avx, y.avx, _CMP_GE_OQ);
+#elif defined(__SSE__)
+    x.sse[0] = _mm_cmpge_ps(x.sse[0], y.sse[0]);
+    x.sse[1] = _mm_cmpge_ps(x.sse[1], y.sse[1]);
+#else
+    for (int i = 0; i < 8; ++i) x.mask[i] = a[i] >= b[i] ? -1 : 0;
+#endif
+    return x.mask;
+}
+
+inline float8 sqrt8(float8 a) {
+    Float8Bits x{a};
+#if defined(__AVX__)
+    x.avx = _mm256_sqrt_ps(x.avx);
+#elif defined(__SSE__)
+    x.sse[0] = _mm_sqrt_ps(x.sse[0]);
+    x.sse[1] = _mm_sqrt_ps(x.sse[1]);
+#else
+    for (int i = 0; i < 8; ++i) x.lanes[i] = std::sqrt(a[i]);
+#endif
+    return x.lanes;
+}
+
+// e^x with a relative error of about 2 ulp (the Cephes polynomial); inputs below -87 give 0
+inline float8 exp8(float8 x) {
+    const float8 LOG2E = broadcast8(1.44269504088896341f);
+    const float8 LN2_HIGH = broadcast8(0.693359375f);
+    const float8 LN2_LOW = broadcast8(-2.12194440e-4f);
+
+    mask8 underflow = less8(x, broadcast8(-87.0f));
+    x = min8(max8(x, broadcast8(-87.0f)), broadcast8(88.0f));
+
+    // x = n ln2 + r with |r| <= ln2 / 2
+    float8 n = x * LOG2E + broadcast8(0.5f);
+    mask8 truncated = __builtin_convertvector(n, mask8);
+    float8 floored = __builtin_convertvector(truncated, float8);
+    floored = select(less8(n, floored), floored - broadcast8(1.0f), floored);
+    x = x - floored * LN2_HIGH - floored * LN2_LOW;
+
+    float8 p = broadcast8(1.9875691500e-4f);
+    p = p * x + broadcast8(1.3981999507e-3f);
+    p = p * x + broadcast8(8.3334519073e-3f);
+    p = p * x + broadcast8(4.1665795894e-2f);
+    p = p * x + broadcast8(1.6666665459e-1f);
+    p = p * x + broadcast8(5.0000001201e-1f);
+    p = p * x * x + x + broadcast8(1.0f);
+
+    // Scale by 2^n through the exponent bits
+    Float8Bits scale;
+    scale.mask = (__builtin_convertvector(floored, mask8) + 127) << 23;
+    return select(underflow, broadcast8(0.0f), p * scale.lanes);
+}
+
+// Eight Vec3s, one per lane
+struct Vec3x8 {
+    float8 x, y, z;
+
+    Vec3x8() = default;
+    Vec3x8(float8 x, float8 y, float8 z) : x(x), y(y), z(z) {}
+    explicit Vec3x8(const Vec3& v) : x(broadcast8(v.x)), y(broadcast8(v.y)), z(broadcast8(v.z)) {}
+
+    Vec3x8 operator + (const Vec3x8& v) const { return Vec3x8(x + v.x, y + v.y, z + v.z); }
+    Vec3x8 operator - (const Vec3x8& v) const { return Vec3x8(x - v.x, y - v.y, z - v.z); }
+    Vec3x8 operator * (float8 k) const { return Vec3x8(x * k, y * k, z * k); }
+    Vec3x8 operator / (float8 k) const { return Vec3x8(x / k, y / k, z / k); }
+    Vec3x8& operator += (const Vec3x8& v) { x += v.x; y += v.y; z += v.z; return *this; }
+
+    float8 dot(const Vec3x8& v) const { return x * v.x + y * v.y + z * v.z; }
+    float8 length() const { return sqrt8(dot(*this)); }
+
+    Vec3 lane(int i) const { return Vec3(x[i], y[i], z[i]); }
+    void setLane(int i, const Vec3& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+};
+
+#endif // FLOAT8_H
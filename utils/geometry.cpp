@@ -3,6 +3,59 @@
 #include <cmath>
 #include <algorithm>
 
+namespace {
+    // Expresses each offset in the triangle's edge basis, then maps it through the UV edges
+    void textureDerivatives(const Vec3& p0, const Vec3& p1, const Vec3& p2,
+                            const Vec3& st0, const Vec3& st1, const Vec3& st2,
+                            const Vec3& dpdx, const Vec3& dpdy, Vec3& duvdx, Vec3& duvdy) {
+        Vec3 e1 = p1 - p0;
+        Vec3 e2 = p2 - p0;
+        float d11 = e1.dot(e1);
+        float d12 = e1.dot(e2);
+        float d22 = e2.dot(e2);
+        float denom = d11 * d22 - d12 * d12;
+        if (std::abs(denom) < 1e-12f) {
+            duvdx = duvdy = Vec3(0.0f);
+            return;
+        }
+
+        Vec3 t1 = st1 - st0;
+        Vec3 t2 = st2 - st0;
+        auto map = [&](const Vec3& dp) {
+            float a = dp.dot(e1);
+            float b = dp.dot(e2);
+            float w1 = (d22 * a - d12 * b) / denom;
+            float w2 = (d11 * b - d12 * a) / denom;
+            return t1 * w1 + t2 * w2;
+        };
+        duvdx = map(dpdx);
+        duvdy = map(dpdy);
+    }
+
+    // Barycentric coordinates of a point on the triangle, weights of p1 and p2
+    void barycentric(const Vec3& p0, const Vec3& p1, const Vec3& p2, const Vec3& hit_point, float& u, float& v) {
+        Vec3 v0 = p1 - p0;
+        Vec3 v1 = p2 - p0;
+        Vec3 v2 = hit_point - p0;
+
+        float d00 = v0.dot(v0);
+        float d01 = v0.dot(v1);
+        float d11 = v1.dot(v1);
+        float d20 = v2.dot(v0);
+        float d21 = v2.dot(v1);
+
+        float denom = d00 * d11 - d01 * d01;
+        if (std::abs(denom) < 1e-8f) {
+            u = v = 0.0f;
+            return;
+        }
+
+        float invDenom = 1.0f / denom;
+        u = (d11 * d20 - d01 * d21) * invDenom;
+        v = (d00 * d21 - d01 * d20) * invDenom;
+    }
+}
+
 /*
  * Ray
  */
@@ -27,11 +80,7 @@ Light::Light(const Vec3 &position, const Vec3& color, float intensity) {
  */
 Primitive::Primitive(const Material &material) : material(material) {}
 
-void Primitive::setHitPoint(const Vec3 &hit_point) {
-    return;
-}
-
-Vec3 Primitive::getTextureCoordinates() const{
+Vec3 Primitive::getTextureCoordinates(const Vec3& hit_point) const{
     return Vec3();
 }
 
@@ -52,7 +101,7 @@ bool Sphere::intersect(const Ray& ray, float& t) const {
     return t >= 0;
 }
 
-bool Sphere::intersect(const Ray& ray, float& t0, float& t1) {
+bool Sphere::intersect(const Ray& ray, float& t0, float& t1) const {
     Vec3 oc = ray.origin - center;
     float a = ray.direction.dot(ray.direction);
     float b = 2.0f * oc.dot(ray.direction);
@@ -110,28 +159,6 @@ BoundingBox Plane::getBoundingBox() const {
 /*
  * Triangle
  */
-void Triangle::setHitPoint(const Vec3& hit_point) {
-    Vec3 v0 = p1 - p0;
-    Vec3 v1 = p2 - p0;
-    Vec3 v2 = hit_point - p0;
-
-    float d00 = v0.dot(v0);
-    float d01 = v0.dot(v1);
-    float d11 = v1.dot(v1);
-    float d20 = v2.dot(v0);
-    float d21 = v2.dot(v1);
-
-    float denom = d00 * d11 - d01 * d01;
-    if (std::abs(denom) < 1e-8f) {
-        u = v = 0.0f;
-        return;
-    }
-
-    float invDenom = 1.0f / denom;
-    u = (d11 * d20 - d01 * d21) * invDenom;
-    v = (d00 * d21 - d01 * d20) * invDenom;
-}
-
 // Möller–Trumbore algorithm for intersection points
 bool Triangle::intersect(const Ray& ray, float& t) const {
     Vec3 edge1 = p1 - p0;
@@ -142,11 +169,11 @@ bool Triangle::intersect(const Ray& ray, float& t) const {
 
     float f = 1.0f / a;
     Vec3 s = ray.origin - p0;
-    u = f * s.dot(h);
+    float u = f * s.dot(h);
     if (u < 0.0f || u > 1.0f) return false;
 
     Vec3 q = s.cross(edge1);
-    v = f * ray.direction.dot(q);
+    float v = f * ray.direction.dot(q);
     if (v < 0.0f || u + v > 1.0f) return false;
 
     t = f * edge2.dot(q);
@@ -154,10 +181,14 @@ bool Triangle::intersect(const Ray& ray, float& t) const {
 }
 
 Vec3 Triangle::getNormal(const Vec3& hit_point) const {
+    float u, v;
+    barycentric(p0, p1, p2, hit_point, u, v);
     return (n1 * (1 - u - v) + n2 * u + n3 * v).normalize();
 }
 
-Vec3 Triangle::getTextureCoordinates() const {
+Vec3 Triangle::getTextureCoordinates(const Vec3& hit_point) const {
+    float u, v;
+    barycentric(p0, p1, p2, hit_point, u, v);
     Vec3 result = st1 * (1 - u - v) + st2 * u + st3 * v;
     return wrap_around(result);
 }
@@ -167,6 +198,10 @@ Vec3 Triangle::getFaceNormal() const {
     return normal;
 }
 
+void Triangle::getTextureDerivatives(const Vec3& dpdx, const Vec3& dpdy, Vec3& duvdx, Vec3& duvdy) const {
+    textureDerivatives(p0, p1, p2, st1, st2, st3, dpdx, dpdy, duvdx, duvdy);
+}
+
 BoundingBox Triangle::getBoundingBox() const {
     Vec3 minVec(
         std::min(std::min(p0.x, p1.x), p2.x),
@@ -181,4 +216,59 @@ BoundingBox Triangle::getBoundingBox() const {
     );
 
     return BoundingBox(minVec, maxVec);
-}
\ No newline at end of file
+}
+
+/*
+ * Compact Triangle
+ */
+bool CompactTriangle::intersect(const Ray& ray, float& t) const {
+    Vec3 p0 = frame->dequantize(q0);
+    Vec3 edge1 = frame->dequantize(q1) - p0;
+    Vec3 edge2 = frame->dequantize(q2) - p0;
+    Vec3 h = ray.direction.cross(edge2);
+    float a = edge1.dot(h);
+    if (a > -1e-6 && a < 1e-6) return false;
+
+    float f = 1.0f / a;
+    Vec3 s = ray.origin - p0;
+    float u = f * s.dot(h);
+    if (u < 0.0f || u > 1.0f) return false;
+
+    Vec3 q = s.cross(edge1);
+    float v = f * ray.direction.dot(q);
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = f * edge2.dot(q);
+    return t > 1e-6;
+}
+
+Vec3 CompactTriangle::getNormal(const Vec3& hit_point) const {
+    float u, v;
+    barycentric(frame->dequantize(q0), frame->dequantize(q1), frame->dequantize(q2), hit_point, u, v);
+    return (decodeOctahedral(n1) * (1 - u - v) + decodeOctahedral(n2) * u + decodeOctahedral(n3) * v).normalize();
+}
+
+Vec3 CompactTriangle::getTextureCoordinates(const Vec3& hit_point) const {
+    float u, v;
+    barycentric(frame->dequantize(q0), frame->dequantize(q1), frame->dequantize(q2), hit_point, u, v);
+    Vec3 result = decodeHalf2(st1) * (1 - u - v) + decodeHalf2(st2) * u + decodeHalf2(st3) * v;
+    return wrap_around(result);
+}
+
+Vec3 CompactTriangle::getFaceNormal() const {
+    Vec3 p0 = frame->dequantize(q0);
+    return (frame->dequantize(q1) - p0).cross(frame->dequantize(q2) - p0).normalize();
+}
+
+void CompactTriangle::getTextureDerivatives(const Vec3& dpdx, const Vec3& dpdy, Vec3& duvdx, Vec3& duvdy) const {
+    textureDerivatives(frame->dequantize(q0), frame->dequantize(q1), frame->dequantize(q2),
+                       decodeHalf2(st1), decodeHalf2(st2), decodeHalf2(st3), dpdx, dpdy, duvdx, duvdy);
+}
+
+BoundingBox CompactTriangle::getBoundingBox() const {
+    BoundingBox bbox;
+    bbox.expand(frame->dequantize(q0));
+    bbox.expand(frame->dequantize(q1));
+    bbox.expand(frame->dequantize(q2));
+    return bbox;
+}
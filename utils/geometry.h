@@ -4,6 +4,9 @@
 #include "vec3.h"
 #include "material.h" 
 #include "utils.h"
+#include "attributes.h"
+#include <array>
+#include <cstdint>
 
 class BoundingBox;
 
@@ -11,6 +14,7 @@ class Ray {
 public:
     Vec3 origin;
     Vec3 direction;
+    Ray() = default;
     Ray(const Vec3& origin, const Vec3& direction);
     Vec3 position(float t) const;
 };
@@ -29,10 +33,10 @@ public:
     Material material;
     Primitive(const Material &material);
     virtual ~Primitive() = default;
-    virtual void setHitPoint(const Vec3& hit_point);
+    // Intersection and shading only read the primitive, so one scene can be traced from many threads
     virtual bool intersect(const Ray& ray, float& t) const = 0;
     virtual Vec3 getNormal(const Vec3& hit_point) const = 0;
-    virtual Vec3 getTextureCoordinates() const;
+    virtual Vec3 getTextureCoordinates(const Vec3& hit_point) const;
     virtual BoundingBox getBoundingBox() const = 0;
 };
 
@@ -43,7 +47,7 @@ public:
 
     Sphere(const Vec3& center, float radius, const Material &material);
     bool intersect(const Ray& ray, float& t) const override;
-    bool intersect(const Ray& ray, float& t0, float& t1);
+    bool intersect(const Ray& ray, float& t0, float& t1) const;
     Vec3 getNormal(const Vec3& hit_point) const override;
     BoundingBox getBoundingBox() const override;
 };
@@ -65,10 +69,6 @@ public:
     Vec3 n1, n2, n3;         // Vertex normals
     Vec3 st1, st2, st3;      // Texture coordinates
 
-private:
-    mutable float u, v;              // Barycentric coordinates
-
-public:
     Triangle(
         const Vec3& p0, const Vec3& p1, const Vec3& p2, 
         const Vec3& n1, const Vec3& n2, const Vec3& n3, 
@@ -78,15 +78,50 @@ public:
         Primitive(material),
         p0(p0), p1(p1), p2(p2), 
         n1(n1.normalize()), n2(n2.normalize()), n3(n3.normalize()), 
-        st1(st1), st2(st2), st3(st3),
-        u(0), v(0) 
+        st1(st1), st2(st2), st3(st3)
+    {}
+
+    bool intersect(const Ray& ray, float& t) const override;
+    Vec3 getNormal(const Vec3& hit_point) const override;
+    Vec3 getTextureCoordinates(const Vec3& hit_point) const override;
+    Vec3 getFaceNormal() const;
+    // Texture coordinate change for the surface offsets dpdx and dpdy (ray differentials at the hit)
+    void getTextureDerivatives(const Vec3& dpdx, const Vec3& dpdy, Vec3& duvdx, Vec3& duvdy) const;
+    BoundingBox getBoundingBox() const override;
+};
+
+/*
+ * Triangle with compressed attributes: positions are quantized against a
+ * shared QuantizationFrame, normals are octahedral and texture coordinates
+ * are half floats. Everything is decoded on the fly when intersecting and
+ * shading, which cuts the attribute storage from 108 to 42 bytes.
+ */
+class CompactTriangle : public Primitive {
+public:
+    std::array<uint16_t, 3> q0, q1, q2;  // Quantized vertex positions
+    uint32_t n1, n2, n3;                 // Octahedral vertex normals
+    uint32_t st1, st2, st3;              // Half-float texture coordinates
+    const QuantizationFrame* frame;      // Shared by every triangle of the mesh
+
+    CompactTriangle(
+        const Vec3& p0, const Vec3& p1, const Vec3& p2,
+        const Vec3& n1, const Vec3& n2, const Vec3& n3,
+        const Vec3& st1, const Vec3& st2, const Vec3& st3,
+        const Material &material, const QuantizationFrame* frame
+    ):
+        Primitive(material),
+        q0(frame->quantize(p0)), q1(frame->quantize(p1)), q2(frame->quantize(p2)),
+        n1(encodeOctahedral(n1)), n2(encodeOctahedral(n2)), n3(encodeOctahedral(n3)),
+        st1(encodeHalf2(st1.x, st1.y)), st2(encodeHalf2(st2.x, st2.y)), st3(encodeHalf2(st3.x, st3.y)),
+        frame(frame)
     {}
 
-    void setHitPoint(const Vec3& hit_point);
     bool intersect(const Ray& ray, float& t) const override;
     Vec3 getNormal(const Vec3& hit_point) const override;
-    Vec3 getTextureCoordinates() const;
+    Vec3 getTextureCoordinates(const Vec3& hit_point) const override;
     Vec3 getFaceNormal() const;
+    // Texture coordinate change for the surface offsets dpdx and dpdy (ray differentials at the hit)
+    void getTextureDerivatives(const Vec3& dpdx, const Vec3& dpdy, Vec3& duvdx, Vec3& duvdy) const;
     BoundingBox getBoundingBox() const override;
 };
 
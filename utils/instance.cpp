@@ -0,0 +1,38 @@
+#include "instance.h"
+
+MeshInstance::MeshInstance(const PrimitiveTree* tree, const BoundingBox& object_bounds, const Vec3& offset, float scale, const Material& material)
+    : Primitive(material), tree(tree), object_bounds(object_bounds), offset(offset), scale(scale) {}
+
+bool MeshInstance::intersect(const Ray& ray, float& t) const {
+    const Triangle* hit;
+    return intersect(ray, t, hit);
+}
+
+bool MeshInstance::intersect(const Ray& ray, float& t, const Triangle*& hit) const {
+    Ray object_ray((ray.origin - offset) / scale, ray.direction);
+
+    float t_object;
+    Primitive* primitive;
+    if (!tree->intersect(object_ray, t_object, primitive)) return false;
+
+    hit = static_cast<const Triangle*>(primitive);
+    t = t_object * scale;
+    return true;
+}
+
+Vec3 MeshInstance::getNormal(const Vec3& hit_point) const {
+    return (hit_point - getBoundingBox().center()).normalize();
+}
+
+BoundingBox MeshInstance::getBoundingBox() const {
+    return BoundingBox(object_bounds.min * scale + offset, object_bounds.max * scale + offset);
+}
+
+Triangle MeshInstance::getWorldTriangle(const Triangle& tri) const {
+    return Triangle(
+        tri.p0 * scale + offset, tri.p1 * scale + offset, tri.p2 * scale + offset,
+        tri.n1, tri.n2, tri.n3,
+        tri.st1, tri.st2, tri.st3,
+        material
+    );
+}
@@ -0,0 +1,34 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "geometry.h"
+#include "bbox.h"
+#include "primitive_tree.h"
+
+/*
+ * A placed copy of a triangle mesh: a bottom-level tree in object space
+ * with a uniform scale and a translation. Several instances can share the
+ * same tree, and a top-level PrimitiveTree over instances gives a two-level
+ * hierarchy. The bottom-level tree must only hold Triangles.
+ */
+class MeshInstance : public Primitive {
+public:
+    const PrimitiveTree* tree;
+    BoundingBox object_bounds;
+    Vec3 offset;
+    float scale;
+
+    MeshInstance(const PrimitiveTree* tree, const BoundingBox& object_bounds, const Vec3& offset, float scale, const Material& material);
+
+    bool intersect(const Ray& ray, float& t) const override;
+    // Also returns the hit triangle, in object space
+    bool intersect(const Ray& ray, float& t, const Triangle*& hit) const;
+    // Instances are shaded through their hit triangle; this only gives the outward direction from the bounds
+    Vec3 getNormal(const Vec3& hit_point) const override;
+    BoundingBox getBoundingBox() const override;
+
+    // A triangle of the bottom-level tree moved into world space
+    Triangle getWorldTriangle(const Triangle& triangle) const;
+};
+
+#endif // INSTANCE_H
@@ -107,13 +107,13 @@ std::shared_ptr<KDNode> KDTree::build(size_t start, size_t end, int depth) {
         BoundingBox current_right_bbox_accum = BoundingBox();
 
         for (int i = num_triangles_in_node - 1; i >= 0; --i) {
-            current_right_bbox_accum.expand(all_triangles[start + i]->getBoundingBox());
+            current_right_bbox_accum = current_right_bbox_accum.expand(all_triangles[start + i]->getBoundingBox());
             right_accumulated_bboxes[i] = current_right_bbox_accum;
         }
 
         BoundingBox left_bbox_accum = BoundingBox();
         for (size_t i = 0; i < num_triangles_in_node - 1; ++i) {
-            left_bbox_accum.expand(all_triangles[start + i]->getBoundingBox());
+            left_bbox_accum = left_bbox_accum.expand(all_triangles[start + i]->getBoundingBox());
             
             BoundingBox right_bbox_to_consider = right_accumulated_bboxes[i + 1];
             
@@ -0,0 +1,45 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, bool sequential) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+
+    mapping_size = static_cast<size_t>(st.st_size);
+    if (mapping_size == 0) return true;
+
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        close();
+        return false;
+    }
+
+    if (sequential) madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapping) munmap(mapping, mapping_size);
+    if (fd >= 0) ::close(fd);
+
+    fd = -1;
+    mapping = nullptr;
+    mapping_size = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // `sequential` hints the kernel to read ahead aggressively
+    bool open(const std::string& path, bool sequential);
+    void close();
+
+    const char* data() const { return static_cast<const char*>(mapping); }
+    size_t size() const { return mapping_size; }
+
+private:
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+};
+
+#endif // MAPPED_FILE_H
@@ -1,168 +1,467 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "mesh.h"
+#include "simplify.h"
+#include "mapped_file.h"
+#include "obj_parser.h"
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
 
-bool Mesh::load(const std::string& meshFile, const std::string& textureFile, int width, int height) {
-    std::ifstream file(meshFile);
-    if (!file.is_open()) {
-        std::cerr << "Could not open mesh file: " << meshFile << std::endl;
-        return false;
+namespace {
+    struct VertexKey {
+        uint32_t bits[8];
+
+        bool operator==(const VertexKey& other) const {
+            return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey& key) const {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (uint32_t word : key.bits) {
+                hash = (hash ^ word) * 0x100000001b3ull;
+            }
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    const char LOD_MAGIC[8] = {'R', 'T', 'L', 'O', 'D', 'S', '\0', '\0'};
+    const uint32_t LOD_VERSION = 1;
+
+    const char CACHE_MAGIC[8] = {'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0'};
+    const uint32_t CACHE_VERSION = 1;
+    const uint64_t CACHE_ALIGNMENT = 64;
+    const std::string CACHE_EXTENSION = ".rtmesh";
+
+    // Followed by the position, UV, normal and index arrays, each starting on a CACHE_ALIGNMENT boundary
+    struct MeshCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t source_size;        // Size and modification time of the OBJ the cache was made from
+        int64_t source_mtime_ns;
+        uint64_t vertex_count;
+        uint64_t index_count;
+        uint64_t position_offset;
+        uint64_t uv_offset;
+        uint64_t normal_offset;
+        uint64_t index_offset;
+    };
+
+    bool source_stamp(const std::string& path, uint64_t& size, int64_t& mtime_ns) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        size = static_cast<uint64_t>(st.st_size);
+        mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return true;
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') {
-            continue;
+    uint64_t align_up(uint64_t offset) {
+        return (offset + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+    }
+
+    bool ends_with(const std::string& value, const std::string& suffix) {
+        return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    double file_size_mb(const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_size / (1024.0 * 1024.0) : 0.0;
+    }
+
+    VertexKey makeKey(const MeshVertex& vertex) {
+        const float values[8] = {vertex.position[0], vertex.position[1], vertex.position[2],
+                                 vertex.uv[0], vertex.uv[1],
+                                 vertex.normal[0], vertex.normal[1], vertex.normal[2]};
+        VertexKey key;
+        for (int i = 0; i < 8; ++i) {
+            float value = values[i] + 0.0f; // Folds -0 into +0
+            std::memcpy(&key.bits[i], &value, sizeof(float));
         }
+        return key;
+    }
+}
 
-        std::istringstream iss(line);
-        std::string type;
-        iss >> type;
-
-        if (type == "v") {
-            processVertex(iss);
-        } else if (type == "vt") {
-            processTexture(iss);
-        } else if (type == "vn") {
-            processNormal(iss);
-        } else if (type == "f") {
-            processFace(iss);
+bool Mesh::load(const std::string& meshFile, const std::string& textureFile, int width, int height) {
+    return loadGeometry(meshFile) && loadTexture(textureFile, width, height);
+}
+
+bool Mesh::loadGeometry(const std::string& meshFile) {
+    if (ends_with(meshFile, CACHE_EXTENSION)) {
+        if (!mapCache(meshFile, "")) {
+            std::cerr << "Invalid mesh cache: " << meshFile << std::endl;
+            return false;
+        }
+    } else if (!cache_enabled || !mapCache(meshFile + CACHE_EXTENSION, meshFile)) {
+        if (!parseObjFile(meshFile)) {
+            return false;
+        }
+        if (cache_enabled) {
+            weld();
+            if (writeCache(meshFile + CACHE_EXTENSION, meshFile)) {
+                std::cout << "Mesh cache written to " << meshFile + CACHE_EXTENSION << std::endl;
+            }
         }
     }
-    file.close();
+    return true;
+}
 
-    if (!loadTexture(textureFile, width, height)) {
+bool Mesh::convert(const std::string& objFile, const std::string& cacheFile) {
+    Mesh mesh;
+    if (!mesh.parseObjFile(objFile)) {
         return false;
     }
+    mesh.weld();
+    return mesh.writeCache(cacheFile, objFile);
+}
 
+bool Mesh::parseObjFile(const std::string& meshFile) {
+    MappedFile file;
+    if (!file.open(meshFile, true)) {
+        std::cerr << "Could not open mesh file: " << meshFile << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ObjData data;
+    parseObjParallel(file.data(), file.data() + file.size(), data, load_threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    file.close();
+
+    double megabytes = file_size_mb(meshFile);
+    std::cout << "Parsed " << megabytes << " MB of OBJ in " << seconds * 1000.0 << " ms ("
+              << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)" << std::endl;
+
+    vertices = std::move(data.vertices);
+    normals = std::move(data.normals);
+    textures = std::move(data.textures);
+    corners = std::move(data.corners);
+    face_offsets = std::move(data.face_offsets);
     return true;
 }
 
-bool Mesh::loadTexture(const std::string& filename, int width, int height) {
-    int texWidth, texHeight, channels;
-    unsigned char* data = stbi_load(filename.c_str(), &texWidth, &texHeight, &channels, 3);
-    if (!data) {
-        std::cerr << "Failed to load texture: " << filename << std::endl;
+bool Mesh::mapCache(const std::string& cachePath, const std::string& sourceFile) {
+    auto start = std::chrono::steady_clock::now();
+    if (!cache_file.open(cachePath, false)) return false;
+
+    const char* base = cache_file.data();
+    size_t size = cache_file.size();
+    MeshCacheHeader header;
+    if (size < sizeof(header)) {
+        cache_file.close();
         return false;
     }
+    std::memcpy(&header, base, sizeof(header));
 
-    texture_width = texWidth;
-    texture_height = texHeight;
-    texture.resize(texture_height, std::vector<std::array<uint8_t, 3>>(texture_width));
+    bool valid = std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == CACHE_VERSION;
+    if (valid && !sourceFile.empty()) {
+        uint64_t source_size;
+        int64_t source_mtime_ns;
+        valid = source_stamp(sourceFile, source_size, source_mtime_ns)
+             && source_size == header.source_size && source_mtime_ns == header.source_mtime_ns;
+        if (!valid) std::cout << "Mesh cache " << cachePath << " is stale, parsing " << sourceFile << std::endl;
+    }
 
-    for (int y = 0; y < texture_height; ++y) {
-        for (int x = 0; x < texture_width; ++x) {
-            int idx = (y * texture_width + x) * 3;
-            texture[y][x] = {data[idx], data[idx + 1], data[idx + 2]};
-        }
+    // Every array has to lie inside the file on an aligned offset so it can be used in place
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return offset % CACHE_ALIGNMENT == 0 && offset <= size && count <= (size - offset) / element_size;
+    };
+    // Indices are checked when the cache is written and clamped by weldedVertex(), not scanned here
+    valid = valid && header.index_count % 3 == 0 && (header.index_count == 0 || header.vertex_count > 0)
+         && fits(header.position_offset, header.vertex_count, 3 * sizeof(float))
+         && fits(header.uv_offset, header.vertex_count, 2 * sizeof(float))
+         && fits(header.normal_offset, header.vertex_count, 3 * sizeof(float))
+         && fits(header.index_offset, header.index_count, sizeof(uint32_t));
+    if (!valid) {
+        cache_file.close();
+        return false;
     }
 
-    stbi_image_free(data);
+    positions = reinterpret_cast<const float*>(base + header.position_offset);
+    uvs = reinterpret_cast<const float*>(base + header.uv_offset);
+    vertex_normals = reinterpret_cast<const float*>(base + header.normal_offset);
+    indices = reinterpret_cast<const uint32_t*>(base + header.index_offset);
+    vertex_count = header.vertex_count;
+    index_count = header.index_count;
+    welded = true;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Mapped " << vertex_count << " vertices and " << index_count / 3 << " triangles from "
+              << cachePath << " in " << seconds * 1000.0 << " ms" << std::endl;
     return true;
 }
 
-Vec3 Mesh::getColorAtUV(float u, float v) const {
-    float x = u * (texture_width - 1);
-    float y = (1.0f - v) * (texture_height - 1);
-    
-    int x0 = std::max(0, std::min(static_cast<int>(std::floor(x)), texture_width - 1));
-    int x1 = std::min(x0 + 1, texture_width - 1);
-    int y0 = std::max(0, std::min(static_cast<int>(std::floor(y)), texture_height - 1));
-    int y1 = std::min(y0 + 1, texture_height - 1);
-
+bool Mesh::writeCache(const std::string& cachePath, const std::string& sourceFile) const {
+    for (size_t i = 0; i < index_count; ++i) {
+        if (indices[i] >= vertex_count) {
+            std::cerr << "Not writing mesh cache " << cachePath << ": index " << indices[i] << " past "
+                      << vertex_count << " vertices" << std::endl;
+            return false;
+        }
+    }
 
-    float xWeight = x - x0;
-    float yWeight = y - y0;
-    
-    std::array<uint8_t, 3> c00 = texture[y0][x0];
-    std::array<uint8_t, 3> c10 = texture[y0][x1];
-    std::array<uint8_t, 3> c01 = texture[y1][x0];
-    std::array<uint8_t, 3> c11 = texture[y1][x1];
-    
-    Vec3 colorTop = Vec3(
-        c00[0] * (1 - xWeight) + c10[0] * xWeight,
-        c00[1] * (1 - xWeight) + c10[1] * xWeight,
-        c00[2] * (1 - xWeight) + c10[2] * xWeight
-    ) / 255.0f;
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    if (!source_stamp(sourceFile, header.source_size, header.source_mtime_ns)) {
+        header.source_size = 0;
+        header.source_mtime_ns = 0;
+    }
+    header.vertex_count = vertex_count;
+    header.index_count = index_count;
+    header.position_offset = align_up(sizeof(header));
+    header.uv_offset = align_up(header.position_offset + vertex_count * 3 * sizeof(float));
+    header.normal_offset = align_up(header.uv_offset + vertex_count * 2 * sizeof(float));
+    header.index_offset = align_up(header.normal_offset + vertex_count * 3 * sizeof(float));
 
-    Vec3 colorBottom = Vec3(
-        c01[0] * (1 - xWeight) + c11[0] * xWeight,
-        c01[1] * (1 - xWeight) + c11[1] * xWeight,
-        c01[2] * (1 - xWeight) + c11[2] * xWeight
-    ) / 255.0f;
+    // Written next to the target and renamed into place, so readers never map a partial file; the
+    // name is per process since farm workers may all build the same cache at once
+    std::string temporary = cachePath + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not write mesh cache: " << cachePath << std::endl;
+        return false;
+    }
 
-    Vec3 finalColor = colorTop * (1 - yWeight) + colorBottom * yWeight;
+    uint64_t written = 0;
+    auto write_at = [&](uint64_t offset, const void* data, uint64_t bytes) {
+        static const char padding[CACHE_ALIGNMENT] = {};
+        file.write(padding, static_cast<std::streamsize>(offset - written));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        written = offset + bytes;
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.position_offset, positions, vertex_count * 3 * sizeof(float));
+    write_at(header.uv_offset, uvs, vertex_count * 2 * sizeof(float));
+    write_at(header.normal_offset, vertex_normals, vertex_count * 3 * sizeof(float));
+    write_at(header.index_offset, indices, index_count * sizeof(uint32_t));
+    file.close();
 
-    return finalColor;
+    if (!file || std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+        std::cerr << "Could not write mesh cache: " << cachePath << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
 }
 
-void Mesh::processVertex(std::istringstream& iss) {
-    std::array<float, 3> vertex;
-    iss >> vertex[0] >> vertex[1] >> vertex[2];
-    vertices.push_back(vertex);
+// The requested size is informational, the image is used at its own resolution
+bool Mesh::loadTexture(const std::string& filename, int width, int height) {
+    if (texture_cache) {
+        cached_texture = texture_cache->open(filename, true);
+        if (!cached_texture) return false;
+        cached_texture->setMipFilter(texture.getMipFilter());
+        return true;
+    }
+    return texture.load(filename, true, texture_layout);
 }
 
-void Mesh::processTexture(std::istringstream& iss) {
-    std::array<float, 2> texture;
-    iss >> texture[0] >> texture[1];
-    textures.push_back(texture);
+BoundingBox Mesh::getBoundingBox() const {
+    BoundingBox bbox;
+    for (size_t i = 0; i < vertex_count; ++i) {
+        bbox.expand(Vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+    }
+    for (const auto& vertex : vertices) {
+        bbox.expand(Vec3(vertex[0], vertex[1], vertex[2]));
+    }
+    return bbox;
 }
 
-void Mesh::processNormal(std::istringstream& iss) {
-    std::array<float, 3> normal;
-    iss >> normal[0] >> normal[1] >> normal[2];
-    normals.push_back(normal);
-}
+void Mesh::weld() {
+    if (welded) return;
 
-void Mesh::processFace(std::istringstream& iss) {
-    std::vector<std::array<int, 3>> face;
-    std::string part;
-    while (iss >> part) {
-        std::array<int, 3> indices = {-1, -1, -1};
+    size_t corner_count = 3 * getTriangleCount(0);
+    size_t source_bytes = vertices.size() * sizeof(vertices[0]) + normals.size() * sizeof(normals[0])
+                        + textures.size() * sizeof(textures[0]) + corners.size() * sizeof(corners[0])
+                        + face_offsets.size() * sizeof(face_offsets[0]);
 
-        size_t firstSlash = part.find('/');
-        size_t secondSlash = part.find('/', firstSlash + 1);
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> lookup;
+    lookup.reserve(corner_count);
+    welded_indices.reserve(corner_count);
 
-        if (firstSlash != std::string::npos) {
-            indices[0] = std::stoi(part.substr(0, firstSlash)) - 1;
-            if (secondSlash != std::string::npos) {
-                if (firstSlash + 1 != secondSlash) {
-                    indices[1] = std::stoi(part.substr(firstSlash + 1, secondSlash - firstSlash - 1)) - 1;
+    for (size_t f = 0; f + 1 < face_offsets.size(); ++f) {
+        const std::array<int, 3>* face = &corners[face_offsets[f]];
+        size_t face_size = face_offsets[f + 1] - face_offsets[f];
+        for (size_t i = 1; i + 1 < face_size; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                MeshVertex vertex = faceCorner(face[j == 0 ? 0 : i + j - 1]);
+
+                auto inserted = lookup.emplace(makeKey(vertex), static_cast<uint32_t>(welded_positions.size() / 3));
+                if (inserted.second) {
+                    welded_positions.insert(welded_positions.end(), vertex.position, vertex.position + 3);
+                    welded_uvs.insert(welded_uvs.end(), vertex.uv, vertex.uv + 2);
+                    welded_normals.insert(welded_normals.end(), vertex.normal, vertex.normal + 3);
                 }
-                indices[2] = std::stoi(part.substr(secondSlash + 1)) - 1;
+                welded_indices.push_back(inserted.first->second);
             }
-        } else {
-            indices[0] = std::stoi(part) - 1;
         }
+    }
+
+    // The indexed buffer replaces the per-attribute lists
+    std::vector<std::array<float, 3>>().swap(vertices);
+    std::vector<std::array<float, 3>>().swap(normals);
+    std::vector<std::array<float, 2>>().swap(textures);
+    std::vector<std::array<int, 3>>().swap(corners);
+    std::vector<uint32_t>(1, 0).swap(face_offsets);
+    welded_positions.shrink_to_fit();
+    welded_uvs.shrink_to_fit();
+    welded_normals.shrink_to_fit();
+
+    positions = welded_positions.data();
+    uvs = welded_uvs.data();
+    vertex_normals = welded_normals.data();
+    indices = welded_indices.data();
+    vertex_count = welded_positions.size() / 3;
+    index_count = welded_indices.size();
+    welded = true;
+
+    size_t expanded_bytes = corner_count * sizeof(MeshVertex);
+    size_t welded_bytes = vertex_count * sizeof(MeshVertex) + index_count * sizeof(uint32_t);
+    std::cout << "Welded " << corner_count << " face corners into " << vertex_count << " unique vertices: "
+              << expanded_bytes / (1024.0 * 1024.0) << " MB expanded, "
+              << source_bytes / (1024.0 * 1024.0) << " MB as loaded -> "
+              << welded_bytes / (1024.0 * 1024.0) << " MB welded ("
+              << (welded_bytes ? static_cast<double>(expanded_bytes) / welded_bytes : 0.0) << "x reduction)" << std::endl;
+}
 
-        face.push_back(indices);
+void Mesh::generateLODs(int maxLevels, float reduction, const std::string& cachePath) {
+    weld();
+    lods.clear();
+
+    if (!cachePath.empty() && loadLODCache(cachePath)) {
+        std::cout << "Loaded " << lods.size() << " simplified levels of detail from " << cachePath << std::endl;
+        return;
+    }
+
+    const uint32_t* previous = indices;
+    size_t previous_count = index_count;
+    for (int level = 1; level < maxLevels; ++level) {
+        size_t target = static_cast<size_t>(previous_count / 3 * reduction);
+        std::vector<uint32_t> simplified = simplifyMesh(positions, vertex_count, previous, previous_count, target);
+        if (simplified.size() > previous_count * 0.9) break; // Only locked borders left to collapse
+
+        lods.push_back(std::move(simplified));
+        previous = lods.back().data();
+        previous_count = lods.back().size();
     }
-    faces.push_back(face);
+
+    for (int level = 0; level < getLevelCount(); ++level) {
+        std::cout << "LOD " << level << ": " << getTriangleCount(level) << " triangles" << std::endl;
+    }
+
+    if (!cachePath.empty()) saveLODCache(cachePath);
 }
 
-std::vector<float> Mesh::getVertexArray() {
-    std::vector<float> vertexArray;
+int Mesh::getLevelCount() const {
+    return 1 + static_cast<int>(lods.size());
+}
 
-    for (const auto& face : faces) {
-        for (size_t i = 1; i < face.size() - 1; ++i) {
-            for (int j = 0; j < 3; ++j) {
-                int di = (j == 0) ? -i : j - 1;
-                
-                const auto& vertex = vertices[face[i + di][0]];
-                vertexArray.insert(vertexArray.end(), vertex.begin(), vertex.end());
-
-                if (face[i + di][1] != -1) {
-                    const auto& texture = textures[face[i + di][1]];
-                    vertexArray.insert(vertexArray.end(), texture.begin(), texture.end());
-                } else {
-                    vertexArray.insert(vertexArray.end(), {0.0f, 0.0f});
-                }
+size_t Mesh::getTriangleCount(int level) const {
+    if (level > 0) return lods[level - 1].size() / 3;
+    if (welded) return index_count / 3;
 
-                const auto& normal = normals[face[i + di][2]];
-                vertexArray.insert(vertexArray.end(), normal.begin(), normal.end());
-            }
+    size_t count = 0;
+    for (size_t f = 0; f + 1 < face_offsets.size(); ++f) {
+        size_t face_size = face_offsets[f + 1] - face_offsets[f];
+        if (face_size >= 3) count += face_size - 2;
+    }
+    return count;
+}
+
+bool Mesh::loadLODCache(const std::string& cachePath) {
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    char magic[8];
+    uint32_t version, levels;
+    uint64_t cached_vertices, cached_indices;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&levels), sizeof(levels));
+    file.read(reinterpret_cast<char*>(&cached_vertices), sizeof(cached_vertices));
+    file.read(reinterpret_cast<char*>(&cached_indices), sizeof(cached_indices));
+
+    // The cache is only valid for the welded mesh it was generated from
+    if (!file || std::memcmp(magic, LOD_MAGIC, sizeof(magic)) != 0 || version != LOD_VERSION
+        || cached_vertices != vertex_count || cached_indices != index_count) {
+        return false;
+    }
+
+    std::vector<std::vector<uint32_t>> loaded(levels);
+    for (auto& level : loaded) {
+        uint64_t count;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || count > cached_indices) return false;
+        level.resize(count);
+        file.read(reinterpret_cast<char*>(level.data()), count * sizeof(uint32_t));
+        for (uint32_t index : level) {
+            if (index >= cached_vertices) return false;
         }
     }
-    return vertexArray;
-}
\ No newline at end of file
+    if (!file) return false;
+
+    lods = std::move(loaded);
+    return true;
+}
+
+void Mesh::saveLODCache(const std::string& cachePath) const {
+    std::string temporary = cachePath + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not write LOD cache: " << cachePath << std::endl;
+        return;
+    }
+
+    uint32_t levels = static_cast<uint32_t>(lods.size());
+    uint64_t cached_vertices = vertex_count;
+    uint64_t cached_indices = index_count;
+    file.write(LOD_MAGIC, sizeof(LOD_MAGIC));
+    file.write(reinterpret_cast<const char*>(&LOD_VERSION), sizeof(LOD_VERSION));
+    file.write(reinterpret_cast<const char*>(&levels), sizeof(levels));
+    file.write(reinterpret_cast<const char*>(&cached_vertices), sizeof(cached_vertices));
+    file.write(reinterpret_cast<const char*>(&cached_indices), sizeof(cached_indices));
+    for (const auto& level : lods) {
+        uint64_t count = level.size();
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(level.data()), count * sizeof(uint32_t));
+    }
+    file.close();
+
+    if (!file || std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+        std::cerr << "Could not write LOD cache: " << cachePath << std::endl;
+        std::remove(temporary.c_str());
+    }
+}
+
+void Mesh::getTriangles(int level, MeshTriangle* out) const {
+    forEachTriangle(level, [&out](const MeshTriangle& triangle) { *out++ = triangle; });
+}
+
+Primitive* makeTriangle(const MeshTriangle& triangle, const Material& material, const QuantizationFrame* frame) {
+    const MeshVertex* c = triangle.corners;
+    Vec3 v0(c[0].position[0], c[0].position[1], c[0].position[2]);
+    Vec3 v1(c[1].position[0], c[1].position[1], c[1].position[2]);
+    Vec3 v2(c[2].position[0], c[2].position[1], c[2].position[2]);
+    Vec3 n0 = Vec3(c[0].normal[0], c[0].normal[1], c[0].normal[2]).normalize();
+    Vec3 n1 = Vec3(c[1].normal[0], c[1].normal[1], c[1].normal[2]).normalize();
+    Vec3 n2 = Vec3(c[2].normal[0], c[2].normal[1], c[2].normal[2]).normalize();
+    Vec3 st0(c[0].uv[0], c[0].uv[1], 0.0f);
+    Vec3 st1(c[1].uv[0], c[1].uv[1], 0.0f);
+    Vec3 st2(c[2].uv[0], c[2].uv[1], 0.0f);
+    if (frame) {
+        return new CompactTriangle(v0, v1, v2, n0, n1, n2, st0, st1, st2, material, frame);
+    }
+    return new Triangle(v0, v1, v2, n0, n1, n2, st0, st1, st2, material);
+}
+
+void appendTriangles(const Mesh& mesh, int level, const Material& material, const QuantizationFrame* frame, std::vector<Primitive*>& primitives) {
+    primitives.reserve(primitives.size() + mesh.getTriangleCount(level));
+
+    mesh.forEachTriangle(level, [&](const MeshTriangle& triangle) {
+        primitives.push_back(makeTriangle(triangle, material, frame));
+    });
+}
@@ -3,37 +3,173 @@
 
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 #include <array>
+#include <cstdint>
+#include <cstring>
 #include "vec3.h"
+#include "bbox.h"
+#include "geometry.h"
+#include "mapped_file.h"
+#include "texture.h"
+#include "texture_cache.h"
+
+// One welded vertex, laid out like a record of the interleaved vertex array
+struct MeshVertex {
+    float position[3];
+    float uv[2];
+    float normal[3];
+};
+
+// One triangle, laid out like 24 consecutive floats of the interleaved vertex array
+struct MeshTriangle {
+    MeshVertex corners[3];
+};
 
 class Mesh {
 public:
+    // `meshFile` is an OBJ file or a mesh cache written by convert(). With the cache enabled, an OBJ
+    // is welded and cached next to itself as <meshFile>.rtmesh on the first load; later loads map
+    // that cache and use its arrays in place for as long as the OBJ is unchanged.
     bool load(const std::string& meshFile, const std::string& textureFile, int width, int height);
 
-    std::vector<float> getVertexArray();
+    // The two halves of load(). They touch disjoint members, so they may run concurrently on one mesh.
+    bool loadGeometry(const std::string& meshFile);
+
+    // Worker threads used to parse the OBJ file, 0 for one per hardware thread
+    void setLoadThreads(unsigned threads) { load_threads = threads; }
+
+    // Enables reading and writing <meshFile>.rtmesh (off by default, since it writes next to the OBJ);
+    // without it the OBJ is parsed every time and kept unwelded
+    void setCacheEnabled(bool enabled) { cache_enabled = enabled; }
+
+    // Parses and welds an OBJ file and writes it as a mesh cache
+    static bool convert(const std::string& objFile, const std::string& cacheFile);
+
+    // Optional load step: merges identical position/normal/UV tuples into an indexed buffer
+    void weld();
+    bool isWelded() const { return welded; }
+
+    // Builds a chain of quadric-simplified levels, each with `reduction` times the triangles of
+    // the previous one; the index buffers are cached in `cachePath` when it is not empty
+    void generateLODs(int maxLevels, float reduction, const std::string& cachePath);
+    int getLevelCount() const;
+    size_t getTriangleCount(int level) const;
+
+    // Calls `emit(const MeshTriangle&)` for every triangle of a level of detail, straight from the
+    // face lists (fan-triangulated) or the welded index buffer
+    template <typename Emit>
+    void forEachTriangle(int level, Emit&& emit) const;
+
+    // Fills `out`, which must have room for getTriangleCount(level) triangles
+    void getTriangles(int level, MeshTriangle* out) const;
 
-    Vec3 getColorAtUV(float u, float v) const;
+    bool loadTexture(const std::string& filename, int width, int height);
+
+    Vec3 getColorAtUV(float u, float v, float lod = 0.0f) const {
+        return cached_texture ? cached_texture->sample(u, v, lod) : texture.sample(u, v, lod);
+    }
+    float getTextureLevelOfDetail(const Vec3& duvdx, const Vec3& duvdy) const {
+        return cached_texture ? cached_texture->getLevelOfDetail(duvdx, duvdy) : texture.getLevelOfDetail(duvdx, duvdy);
+    }
+    const Texture& getTexture() const { return texture; }
+    void setMipFilter(MipFilter filter) { texture.setMipFilter(filter); }
+    // Apply to textures loaded afterwards; with a cache, tiles are paged in on demand instead of decoding the image
+    void setTextureLayout(TextureLayout layout) { texture_layout = layout; }
+    void setTextureCache(TextureCache* cache) { texture_cache = cache; }
+
+    BoundingBox getBoundingBox() const;
 
 private:
     std::vector<std::array<float, 3>> vertices;
     std::vector<std::array<float, 3>> normals;
     std::vector<std::array<float, 2>> textures;
-    std::vector<std::vector<std::array<int, 3>>> faces;
+    std::vector<std::array<int, 3>> corners;   // v/vt/vn of every face corner, see ObjData
+    std::vector<uint32_t> face_offsets{0};
 
-    std::vector<std::vector<std::array<uint8_t, 3>>> texture;
+    unsigned load_threads = 0;
+    bool cache_enabled = false;
 
-    int texture_width = 0;
-    int texture_height = 0;
+    // Welded, indexed form. The arrays point into the welded_* vectors after weld(), or straight
+    // into the mapped mesh cache.
+    bool welded = false;
+    const float* positions = nullptr;        // 3 floats per vertex
+    const float* uvs = nullptr;              // 2 floats per vertex
+    const float* vertex_normals = nullptr;   // 3 floats per vertex
+    const uint32_t* indices = nullptr;
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    std::vector<float> welded_positions;
+    std::vector<float> welded_uvs;
+    std::vector<float> welded_normals;
+    std::vector<uint32_t> welded_indices;
+    MappedFile cache_file;
 
-    void processVertex(std::istringstream& iss);
-    void processTexture(std::istringstream& iss);
-    void processNormal(std::istringstream& iss);
-    void processFace(std::istringstream& iss);
+    std::vector<std::vector<uint32_t>> lods;   // Levels 1.. of detail, sharing the welded vertices
 
-    bool loadTexture(const std::string& filename, int width, int height);
+    bool parseObjFile(const std::string& meshFile);
+    // `sourceFile` is the OBJ the cache was made from, empty to skip the staleness check
+    bool mapCache(const std::string& cachePath, const std::string& sourceFile);
+    bool writeCache(const std::string& cachePath, const std::string& sourceFile) const;
+    MeshVertex weldedVertex(uint32_t index) const;
+    MeshVertex faceCorner(const std::array<int, 3>& corner) const;
+
+    bool loadLODCache(const std::string& cachePath);
+    void saveLODCache(const std::string& cachePath) const;
+
+    Texture texture;
+    TextureLayout texture_layout = TextureLayout::Linear;
+    TextureCache* texture_cache = nullptr;
+    CachedTexture* cached_texture = nullptr;   // Owned by texture_cache
 };
 
+// Builds a Triangle, or a CompactTriangle when a quantization frame is given
+Primitive* makeTriangle(const MeshTriangle& triangle, const Material& material, const QuantizationFrame* frame);
+// Appends one of makeTriangle() for every triangle of a level of detail
+void appendTriangles(const Mesh& mesh, int level, const Material& material, const QuantizationFrame* frame, std::vector<Primitive*>& primitives);
+
+inline MeshVertex Mesh::weldedVertex(uint32_t index) const {
+    // A damaged cache may hold indices past the vertices; those read the first vertex instead
+    if (index >= vertex_count) index = 0;
+    MeshVertex vertex;
+    std::memcpy(vertex.position, positions + 3 * static_cast<size_t>(index), sizeof(vertex.position));
+    std::memcpy(vertex.uv, uvs + 2 * static_cast<size_t>(index), sizeof(vertex.uv));
+    std::memcpy(vertex.normal, vertex_normals + 3 * static_cast<size_t>(index), sizeof(vertex.normal));
+    return vertex;
+}
+
+inline MeshVertex Mesh::faceCorner(const std::array<int, 3>& corner) const {
+    MeshVertex vertex = {};
+    std::memcpy(vertex.position, vertices[corner[0]].data(), sizeof(vertex.position));
+    if (corner[1] != -1) std::memcpy(vertex.uv, textures[corner[1]].data(), sizeof(vertex.uv));
+    if (corner[2] != -1) std::memcpy(vertex.normal, normals[corner[2]].data(), sizeof(vertex.normal));
+    return vertex;
+}
+
+template <typename Emit>
+void Mesh::forEachTriangle(int level, Emit&& emit) const {
+    MeshTriangle triangle;
+    if (level > 0 || welded) {
+        const uint32_t* level_indices = level > 0 ? lods[level - 1].data() : indices;
+        size_t count = level > 0 ? lods[level - 1].size() : index_count;
+        for (size_t i = 0; i + 2 < count; i += 3) {
+            for (int k = 0; k < 3; ++k) triangle.corners[k] = weldedVertex(level_indices[i + k]);
+            emit(static_cast<const MeshTriangle&>(triangle));
+        }
+        return;
+    }
+
+    for (size_t f = 0; f + 1 < face_offsets.size(); ++f) {
+        const std::array<int, 3>* face = &corners[face_offsets[f]];
+        size_t face_size = face_offsets[f + 1] - face_offsets[f];
+        for (size_t i = 1; i + 1 < face_size; ++i) {
+            triangle.corners[0] = faceCorner(face[0]);
+            triangle.corners[1] = faceCorner(face[i]);
+            triangle.corners[2] = faceCorner(face[i + 1]);
+            emit(static_cast<const MeshTriangle&>(triangle));
+        }
+    }
+}
+
 #endif // MESH_H
\ No newline at end of file
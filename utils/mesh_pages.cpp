@@ -0,0 +1,836 @@
+#include "mesh_pages.h"
+#include "attributes.h"
+#include "mesh_stream.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <queue>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char PAGE_MAGIC[8] = {'R', 'T', 'P', 'A', 'G', 'E', 'S', '\0'};
+    const uint32_t PAGE_VERSION = 2;
+    const size_t PAGE_ALIGNMENT = 4096;
+    const size_t MAX_TRIANGLES_PER_LEAF = 4;
+    const int MAX_BUILD_DEPTH = 60;                 // Keeps traversal within its fixed-size stack
+    const int SAH_BINS = 16;
+    const uint64_t BLOCK_TRIANGLES = 1 << 16;       // Largest run of sorted triangles given an SAH tree
+    const size_t STREAM_BATCH_TRIANGLES = 1 << 14;  // Parsed triangles handed to a worker at a time
+    const size_t STREAM_QUEUE_DEPTH = 4;
+    const uint64_t SORT_RUN_TRIANGLES = 1 << 18;    // Sorted in memory at a time, 20 MB
+    const size_t MERGE_BUFFER_TRIANGLES = 4096;     // Read ahead per sorted run, and written at a time
+    const uint64_t MORTON_CELLS = 1 << 21;          // Per axis
+
+    bool source_stamp(const std::string& path, uint64_t& size, int64_t& mtime_ns) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        size = static_cast<uint64_t>(st.st_size);
+        mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return true;
+    }
+
+    struct Bounds {
+        float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+        float max[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+        void expand(const float p[3]) {
+            for (int i = 0; i < 3; ++i) {
+                min[i] = std::min(min[i], p[i]);
+                max[i] = std::max(max[i], p[i]);
+            }
+        }
+
+        void expand(const Bounds& b) {
+            expand(b.min);
+            expand(b.max);
+        }
+
+        float area() const {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            if (dx < 0.0f) return 0.0f;
+            return 2.0f * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    size_t alignUp(size_t value) {
+        return (value + PAGE_ALIGNMENT - 1) / PAGE_ALIGNMENT * PAGE_ALIGNMENT;
+    }
+
+    struct BuildNode {
+        Bounds bounds;
+        uint32_t start, count;
+        int left = -1, right = -1;
+    };
+
+    // Binned SAH build over triangle indices; reorders `order` so that every leaf is contiguous.
+    // `depth` is that of the root in the whole tree, which MAX_BUILD_DEPTH bounds.
+    class PageBuilder {
+    public:
+        std::vector<BuildNode> nodes;
+
+        PageBuilder(const std::vector<Bounds>& bounds, std::vector<uint32_t>& order, int depth)
+            : bounds(bounds), order(order), centroids(bounds.size() * 3) {
+            for (size_t i = 0; i < bounds.size(); ++i) {
+                for (int a = 0; a < 3; ++a) {
+                    centroids[i * 3 + a] = 0.5f * (bounds[i].min[a] + bounds[i].max[a]);
+                }
+            }
+            build(0, static_cast<uint32_t>(order.size()), depth);
+        }
+
+    private:
+        const std::vector<Bounds>& bounds;
+        std::vector<uint32_t>& order;
+        std::vector<float> centroids;
+
+        int build(uint32_t start, uint32_t end, int depth) {
+            int index = static_cast<int>(nodes.size());
+            nodes.emplace_back();
+
+            Bounds node_bounds, centroid_bounds;
+            for (uint32_t i = start; i < end; ++i) {
+                node_bounds.expand(bounds[order[i]]);
+                centroid_bounds.expand(&centroids[order[i] * 3]);
+            }
+            nodes[index].bounds = node_bounds;
+            nodes[index].start = start;
+            nodes[index].count = end - start;
+
+            uint32_t count = end - start;
+            if (count <= MAX_TRIANGLES_PER_LEAF || depth >= MAX_BUILD_DEPTH) return index;
+
+            float best_cost = std::numeric_limits<float>::max();
+            int best_axis = -1, best_bin = -1;
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+                if (extent <= 0.0f) continue;
+
+                Bounds bin_bounds[SAH_BINS];
+                uint32_t bin_counts[SAH_BINS] = {};
+                for (uint32_t i = start; i < end; ++i) {
+                    int bin = binOf(order[i], axis, centroid_bounds.min[axis], extent);
+                    bin_counts[bin]++;
+                    bin_bounds[bin].expand(bounds[order[i]]);
+                }
+
+                float right_area[SAH_BINS];
+                uint32_t right_count[SAH_BINS];
+                Bounds accum;
+                uint32_t accum_count = 0;
+                for (int b = SAH_BINS - 1; b > 0; --b) {
+                    accum.expand(bin_bounds[b]);
+                    accum_count += bin_counts[b];
+                    right_area[b] = accum.area();
+                    right_count[b] = accum_count;
+                }
+
+                accum = Bounds();
+                accum_count = 0;
+                for (int b = 0; b < SAH_BINS - 1; ++b) {
+                    accum.expand(bin_bounds[b]);
+                    accum_count += bin_counts[b];
+                    if (accum_count == 0 || right_count[b + 1] == 0) continue;
+                    float cost = accum.area() * accum_count + right_area[b + 1] * right_count[b + 1];
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = b;
+                    }
+                }
+            }
+
+            uint32_t mid;
+            if (best_axis == -1) {
+                // Every centroid coincides: split the range in half
+                mid = start + count / 2;
+            } else {
+                float origin = centroid_bounds.min[best_axis];
+                float extent = centroid_bounds.max[best_axis] - origin;
+                auto split = std::partition(order.begin() + start, order.begin() + end, [&](uint32_t tri) {
+                    return binOf(tri, best_axis, origin, extent) <= best_bin;
+                });
+                mid = static_cast<uint32_t>(split - order.begin());
+            }
+
+            int left = build(start, mid, depth + 1);
+            int right = build(mid, end, depth + 1);
+            nodes[index].left = left;
+            nodes[index].right = right;
+            return index;
+        }
+
+        int binOf(uint32_t tri, int axis, float origin, float extent) const {
+            int bin = static_cast<int>(SAH_BINS * (centroids[tri * 3 + axis] - origin) / extent);
+            return std::min(std::max(bin, 0), SAH_BINS - 1);
+        }
+    };
+
+    PagedNode toPagedNode(const BuildNode& node) {
+        PagedNode paged;
+        for (int a = 0; a < 3; ++a) {
+            paged.bmin[a] = node.bounds.min[a];
+            paged.bmax[a] = node.bounds.max[a];
+        }
+        paged.offset = node.start;
+        paged.count = node.left == -1 ? node.count : 0;
+        return paged;
+    }
+
+
+    // A triangle on its way through the external sort: the Morton code of its centroid, then its
+    // position in the file to break ties, so the order does not depend on which thread stored it
+    struct SortRecord {
+        uint64_t key;
+        uint64_t id;
+        PagedTriangle tri;
+    };
+
+    bool readAt(int fd, void* data, size_t bytes, uint64_t offset) {
+        char* position = static_cast<char*>(data);
+        while (bytes > 0) {
+            ssize_t done = pread(fd, position, bytes, static_cast<off_t>(offset));
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) return false;
+            position += done;
+            offset += static_cast<uint64_t>(done);
+            bytes -= static_cast<size_t>(done);
+        }
+        return true;
+    }
+
+    bool writeAt(int fd, const void* data, size_t bytes, uint64_t offset) {
+        const char* position = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t done = pwrite(fd, position, bytes, static_cast<off_t>(offset));
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) return false;
+            position += done;
+            offset += static_cast<uint64_t>(done);
+            bytes -= static_cast<size_t>(done);
+        }
+        return true;
+    }
+
+    PagedTriangle toPagedTriangle(const MeshTriangle& triangle) {
+        PagedTriangle tri;
+        for (int k = 0; k < 3; ++k) {
+            const MeshVertex& corner = triangle.corners[k];
+            tri.p[k][0] = corner.position[0];
+            tri.p[k][1] = corner.position[1];
+            tri.p[k][2] = corner.position[2];
+            tri.st[k] = encodeHalf2(corner.uv[0], corner.uv[1]);
+            tri.n[k] = encodeOctahedral(Vec3(corner.normal[0], corner.normal[1], corner.normal[2]).normalize());
+        }
+        tri.pad = 0;
+        return tri;
+    }
+
+    void centroid(const PagedTriangle& tri, float c[3]) {
+        for (int a = 0; a < 3; ++a) c[a] = (tri.p[0][a] + tri.p[1][a] + tri.p[2][a]) / 3.0f;
+    }
+
+    // 21 bits per axis, interleaved
+    uint64_t spreadBits(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    // Every axis is quantized at the scale of the longest, so the cells are cubes and a flat mesh is not
+    // cut across its thin side first
+    uint64_t mortonKey(const PagedTriangle& tri, const Bounds& centroids) {
+        float c[3];
+        centroid(tri, c);
+        float extent = std::max({centroids.max[0] - centroids.min[0], centroids.max[1] - centroids.min[1], centroids.max[2] - centroids.min[2]});
+        uint64_t key = 0;
+        for (int a = 0; a < 3; ++a) {
+            float unit = extent > 0.0f ? (c[a] - centroids.min[a]) / extent : 0.0f;
+            key |= spreadBits(static_cast<uint64_t>(std::clamp(unit, 0.0f, 1.0f) * float(MORTON_CELLS - 1))) << a;
+        }
+        return key;
+    }
+
+    bool sortedBefore(const SortRecord& a, const SortRecord& b) {
+        return a.key < b.key || (a.key == b.key && a.id < b.id);
+    }
+
+    // Yields the triangles of sorted runs of the sort file in sorted order, reading each run a buffer at a time
+    class RunMerger {
+    public:
+        bool failed = false;
+
+        RunMerger(int fd, uint64_t count) : fd(fd), queue(Earlier{this}) {
+            for (uint64_t first = 0; first < count; first += SORT_RUN_TRIANGLES) {
+                runs.push_back({first, std::min(count, first + SORT_RUN_TRIANGLES), {}, 0});
+            }
+            for (size_t i = 0; i < runs.size(); ++i) {
+                if (refill(runs[i])) queue.push(i);
+            }
+        }
+
+        PagedTriangle next() {
+            size_t index = queue.top();
+            queue.pop();
+            Run& run = runs[index];
+            PagedTriangle tri = run.buffer[run.position++].tri;
+            if (run.position < run.buffer.size() || refill(run)) queue.push(index);
+            return tri;
+        }
+
+    private:
+        struct Run {
+            uint64_t next, end;
+            std::vector<SortRecord> buffer;
+            size_t position;
+        };
+
+        struct Earlier {
+            const RunMerger* merger;
+            bool operator()(size_t a, size_t b) const {
+                const Run& run_a = merger->runs[a];
+                const Run& run_b = merger->runs[b];
+                return sortedBefore(run_b.buffer[run_b.position], run_a.buffer[run_a.position]);
+            }
+        };
+
+        int fd;
+        std::vector<Run> runs;
+        std::priority_queue<size_t, std::vector<size_t>, Earlier> queue;
+
+        bool refill(Run& run) {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(MERGE_BUFFER_TRIANGLES, run.end - run.next));
+            run.buffer.resize(count);
+            run.position = 0;
+            if (count == 0) return false;
+            if (!readAt(fd, run.buffer.data(), count * sizeof(SortRecord), run.next * sizeof(SortRecord))) {
+                failed = true;
+                run.buffer.assign(count, SortRecord{});
+            }
+            run.next += count;
+            return true;
+        }
+    };
+
+    // Writes the tree over the merged triangles. The sorted order is split at the median down to blocks of
+    // at most BLOCK_TRIANGLES, and each block gets a binned SAH tree built in memory. Nodes within the
+    // resident levels are kept until the end and then written breadth-first at the front of the node
+    // section; those below go depth-first after a region reserved for them, each block's in one write.
+    class PageWriter {
+    public:
+        bool failed = false;
+
+        PageWriter(int fd, uint64_t triangle_offset, uint64_t node_offset, RunMerger& input, int resident_levels, size_t deferred_first)
+            : fd(fd), triangle_offset(triangle_offset), node_offset(node_offset), input(input),
+              resident_levels(resident_levels), next_slot(deferred_first) {
+            buffer.reserve(MERGE_BUFFER_TRIANGLES);
+        }
+
+        void writeTree(uint64_t count) {
+            top.resize(1);
+            writeMedian(Target{0, 0}, 0, count, 0);
+            flushTriangles();
+        }
+
+        size_t getSlotCount() const { return next_slot; }
+
+        // The resident levels in breadth-first order, with the offsets of their children filled in
+        std::vector<PagedNode> residentNodes() const {
+            std::vector<PagedNode> nodes;
+            std::vector<int> order(1, 0);
+            nodes.reserve(top.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                const TopNode& entry = top[order[i]];
+                nodes.push_back(entry.node);
+                if (entry.children >= 0) {
+                    nodes.back().offset = static_cast<uint32_t>(order.size());
+                    order.push_back(entry.children);
+                    order.push_back(entry.children + 1);
+                }
+            }
+            return nodes;
+        }
+
+    private:
+        // Where a node goes: an entry of `top` within the resident levels, a slot below them
+        struct Target {
+            int top;
+            size_t slot;
+        };
+
+        struct TopNode {
+            PagedNode node;
+            int children = -1;      // First of the two adjacent entries of its children in `top`
+        };
+
+        int fd;
+        uint64_t triangle_offset;
+        uint64_t node_offset;
+        uint64_t written = 0;
+        std::vector<PagedTriangle> buffer;
+        RunMerger& input;
+        int resident_levels;
+        size_t next_slot;
+        std::vector<TopNode> top;
+        std::vector<PagedNode> block_nodes;     // Slots from block_first on, while a block is written
+        size_t block_first = std::numeric_limits<size_t>::max();
+
+        std::pair<Target, Target> childPair(int depth) {
+            if (depth <= resident_levels) {
+                int first = static_cast<int>(top.size());
+                top.resize(top.size() + 2);
+                return {Target{first, 0}, Target{first + 1, 0}};
+            }
+            size_t pair = next_slot;
+            next_slot += 2;
+            return {Target{-1, pair}, Target{-1, pair + 1}};
+        }
+
+        void store(const Target& target, PagedNode node, const Target& children, const Bounds& bounds) {
+            std::memcpy(node.bmin, bounds.min, sizeof(node.bmin));
+            std::memcpy(node.bmax, bounds.max, sizeof(node.bmax));
+            if (node.count == 0 && children.top < 0) node.offset = static_cast<uint32_t>(children.slot);
+            if (target.top >= 0) {
+                top[target.top].node = node;
+                top[target.top].children = node.count == 0 ? children.top : -1;
+            } else if (target.slot >= block_first) {
+                if (block_nodes.size() <= target.slot - block_first) block_nodes.resize(target.slot - block_first + 1);
+                block_nodes[target.slot - block_first] = node;
+            } else if (!writeAt(fd, &node, sizeof(node), node_offset + target.slot * sizeof(PagedNode))) {
+                failed = true;
+            }
+        }
+
+        Bounds writeMedian(const Target& target, uint64_t first, uint64_t count, int depth) {
+            if (count <= BLOCK_TRIANGLES) return writeBlock(target, first, count, depth);
+
+            auto [left, right] = childPair(depth + 1);
+            Bounds bounds = writeMedian(left, first, count / 2, depth + 1);
+            bounds.expand(writeMedian(right, first + count / 2, count - count / 2, depth + 1));
+            store(target, PagedNode{{}, {}, 0, 0}, left, bounds);
+            return bounds;
+        }
+
+        Bounds writeBlock(const Target& target, uint64_t first, uint64_t count, int depth) {
+            std::vector<PagedTriangle> block(count);
+            std::vector<Bounds> bounds(count);
+            std::vector<uint32_t> order(count);
+            for (uint64_t i = 0; i < count; ++i) {
+                block[i] = input.next();
+                for (int k = 0; k < 3; ++k) bounds[i].expand(block[i].p[k]);
+                order[i] = static_cast<uint32_t>(i);
+            }
+            PageBuilder builder(bounds, order, depth);
+            for (uint32_t index : order) appendTriangle(block[index]);
+
+            // Every slot the block allocates follows the ones before it, so its nodes go out as one run
+            block_first = next_slot;
+            block_nodes.clear();
+            Bounds block_bounds = writeBuilt(builder.nodes, 0, target, first, depth);
+            if (!block_nodes.empty() && !writeAt(fd, block_nodes.data(), block_nodes.size() * sizeof(PagedNode), node_offset + block_first * sizeof(PagedNode))) {
+                failed = true;
+            }
+            block_first = std::numeric_limits<size_t>::max();
+            return block_bounds;
+        }
+
+        Bounds writeBuilt(const std::vector<BuildNode>& nodes, int index, const Target& target, uint64_t first, int depth) {
+            const BuildNode& built = nodes[index];
+            PagedNode node = toPagedNode(built);
+            Target children{-1, 0};
+            if (built.left == -1) {
+                node.offset = static_cast<uint32_t>(first + built.start);
+            } else {
+                auto [left, right] = childPair(depth + 1);
+                writeBuilt(nodes, built.left, left, first, depth + 1);
+                writeBuilt(nodes, built.right, right, first, depth + 1);
+                children = left;
+            }
+            store(target, node, children, built.bounds);
+            return built.bounds;
+        }
+
+        void appendTriangle(const PagedTriangle& tri) {
+            buffer.push_back(tri);
+            if (buffer.size() == MERGE_BUFFER_TRIANGLES) flushTriangles();
+        }
+
+        void flushTriangles() {
+            if (buffer.empty()) return;
+            if (!writeAt(fd, buffer.data(), buffer.size() * sizeof(PagedTriangle), triangle_offset + written * sizeof(PagedTriangle))) failed = true;
+            written += buffer.size();
+            buffer.clear();
+        }
+    };
+
+    bool intersectBox(const PagedNode& node, const Vec3& origin, const Vec3& inv_dir, float t_max, float& t_entry) {
+        float t0 = 0.0f, t1 = t_max;
+        for (int a = 0; a < 3; ++a) {
+            float near = (node.bmin[a] - origin[a]) * inv_dir[a];
+            float far = (node.bmax[a] - origin[a]) * inv_dir[a];
+            if (near > far) std::swap(near, far);
+            t0 = std::max(t0, near);
+            t1 = std::min(t1, far);
+            if (t1 < t0) return false;
+        }
+        t_entry = t0;
+        return true;
+    }
+
+    bool intersectTriangle(const PagedTriangle& tri, const Ray& ray, float& t) {
+        Vec3 p0(tri.p[0][0], tri.p[0][1], tri.p[0][2]);
+        Vec3 edge1 = Vec3(tri.p[1][0], tri.p[1][1], tri.p[1][2]) - p0;
+        Vec3 edge2 = Vec3(tri.p[2][0], tri.p[2][1], tri.p[2][2]) - p0;
+        Vec3 h = ray.direction.cross(edge2);
+        float a = edge1.dot(h);
+        if (a > -1e-6 && a < 1e-6) return false;
+
+        float f = 1.0f / a;
+        Vec3 s = ray.origin - p0;
+        float u = f * s.dot(h);
+        if (u < 0.0f || u > 1.0f) return false;
+
+        Vec3 q = s.cross(edge1);
+        float v = f * ray.direction.dot(q);
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        t = f * edge2.dot(q);
+        return t > 1e-6;
+    }
+}
+
+PagedMesh::~PagedMesh() {
+    close();
+}
+
+bool PagedMesh::build(const std::string& path, const std::string& source_path, int resident_levels) {
+    // The sort file is unlinked straight away, so it goes with its descriptor on every return
+    std::string sort_path = path + "." + std::to_string(getpid()) + ".sort";
+    int sort_fd = ::open(sort_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (sort_fd < 0) {
+        std::cerr << "Could not create page file: " << path << std::endl;
+        return false;
+    }
+    ::unlink(sort_path.c_str());
+
+    // Store the triangles as they are parsed, in whatever order the batches arrive
+    std::mutex mutex;
+    uint64_t count = 0;
+    Bounds centroids;
+    std::atomic<bool> store_failed{false};
+    StreamStats stream_stats;
+    bool streamed = streamObjTriangles(source_path, STREAM_BATCH_TRIANGLES, 0, STREAM_QUEUE_DEPTH, [&](TriangleBatch& batch) {
+        if (batch.triangles.empty()) return;
+        std::vector<SortRecord> records(batch.triangles.size());
+        Bounds batch_centroids;
+        for (size_t i = 0; i < records.size(); ++i) {
+            records[i].key = 0;
+            records[i].id = (static_cast<uint64_t>(batch.index) << 32) | i;
+            records[i].tri = toPagedTriangle(batch.triangles[i]);
+            float c[3];
+            centroid(records[i].tri, c);
+            batch_centroids.expand(c);
+        }
+
+        uint64_t first;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            first = count;
+            count += records.size();
+            centroids.expand(batch_centroids);
+        }
+        if (!writeAt(sort_fd, records.data(), records.size() * sizeof(SortRecord), first * sizeof(SortRecord))) store_failed = true;
+    }, stream_stats);
+    // Node slots, at most twice the triangles plus the reserved levels, are 32-bit as well
+    if (!streamed || store_failed || count == 0 || count > std::numeric_limits<uint32_t>::max() / 4) {
+        if (streamed && !store_failed) std::cerr << "Cannot page a mesh with " << count << " triangles" << std::endl;
+        else if (store_failed) std::cerr << "Could not write page file: " << path << std::endl;
+        ::close(sort_fd);
+        return false;
+    }
+
+    // Sort runs in memory along the Morton curve of the centroids and write each back in place
+    {
+        std::vector<SortRecord> run;
+        for (uint64_t first = 0; first < count; first += SORT_RUN_TRIANGLES) {
+            run.resize(static_cast<size_t>(std::min<uint64_t>(SORT_RUN_TRIANGLES, count - first)));
+            if (!readAt(sort_fd, run.data(), run.size() * sizeof(SortRecord), first * sizeof(SortRecord))) {
+                std::cerr << "Could not read back the triangles of page file: " << path << std::endl;
+                ::close(sort_fd);
+                return false;
+            }
+            for (SortRecord& record : run) record.key = mortonKey(record.tri, centroids);
+            std::sort(run.begin(), run.end(), sortedBefore);
+            if (!writeAt(sort_fd, run.data(), run.size() * sizeof(SortRecord), first * sizeof(SortRecord))) {
+                std::cerr << "Could not write page file: " << path << std::endl;
+                ::close(sort_fd);
+                return false;
+            }
+        }
+    }
+
+    // Triangles first, then the nodes, whose count is only known once the tree is written. The resident
+    // levels get room for a full tree of their depth; what a shallower tree leaves of it stays a hole.
+    int expanded_levels = std::clamp(resident_levels, 1, 30);
+    size_t reserved = static_cast<size_t>(std::min<uint64_t>((2ull << expanded_levels) - 1, 2 * count - 1));
+
+    PagedMeshHeader header;
+    std::memcpy(header.magic, PAGE_MAGIC, sizeof(header.magic));
+    header.version = PAGE_VERSION;
+    header.triangle_count = count;
+    header.triangle_offset = alignUp(sizeof(PagedMeshHeader));
+    header.node_offset = alignUp(header.triangle_offset + count * sizeof(PagedTriangle));
+    if (!source_stamp(source_path, header.source_size, header.source_mtime_ns)) {
+        header.source_size = 0;
+        header.source_mtime_ns = 0;
+    }
+
+    // Renamed into place once complete, so a process opening the file never sees half of it
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not create page file: " << path << std::endl;
+        ::close(sort_fd);
+        return false;
+    }
+
+    RunMerger merger(sort_fd, count);
+    PageWriter writer(fd, header.triangle_offset, header.node_offset, merger, expanded_levels, reserved);
+    writer.writeTree(count);
+    std::vector<PagedNode> resident = writer.residentNodes();
+    header.resident_nodes = static_cast<uint32_t>(resident.size());
+    header.node_count = writer.getSlotCount() > reserved ? writer.getSlotCount() : resident.size();
+
+    bool written = !merger.failed && !writer.failed
+                && writeAt(fd, resident.data(), resident.size() * sizeof(PagedNode), header.node_offset)
+                && ftruncate(fd, static_cast<off_t>(header.node_offset + header.node_count * sizeof(PagedNode))) == 0
+                && writeAt(fd, &header, sizeof(header), 0);
+    written = ::close(fd) == 0 && written;
+    ::close(sort_fd);
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write page file: " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PagedMesh::isCurrent(const std::string& path, const std::string& source_path) {
+    PagedMeshHeader header;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, PAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != PAGE_VERSION) {
+        return false;
+    }
+
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    if (!source_stamp(source_path, source_size, source_mtime_ns)) return true;
+    return source_size == header.source_size && source_mtime_ns == header.source_mtime_ns;
+}
+
+bool PagedMesh::open(const std::string& path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open page file: " << path << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(PagedMeshHeader)) {
+        std::cerr << "Invalid page file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    mapping_size = static_cast<size_t>(st.st_size);
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        std::cerr << "Could not map page file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    const PagedMeshHeader* header = static_cast<const PagedMeshHeader*>(mapping);
+    if (std::memcmp(header->magic, PAGE_MAGIC, sizeof(PAGE_MAGIC)) != 0 || header->version != PAGE_VERSION) {
+        std::cerr << "Unsupported page file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    // Both sections have to lie inside the file on aligned offsets; child and triangle indices are
+    // checked during traversal instead of by a scan of every node here
+    auto fits = [this](uint64_t offset, uint64_t count, size_t element_size, size_t alignment) {
+        return offset % alignment == 0 && offset <= mapping_size && count <= (mapping_size - offset) / element_size;
+    };
+    if (!fits(header->node_offset, header->node_count, sizeof(PagedNode), alignof(PagedNode))
+        || !fits(header->triangle_offset, header->triangle_count, sizeof(PagedTriangle), alignof(PagedTriangle))
+        || header->resident_nodes > header->node_count) {
+        std::cerr << "Invalid page file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    nodes = reinterpret_cast<const PagedNode*>(base + header->node_offset);
+    triangles = reinterpret_cast<const PagedTriangle*>(base + header->triangle_offset);
+    node_count = header->node_count;
+    triangle_count = header->triangle_count;
+    resident_nodes = header->resident_nodes;
+
+    // Deep subtrees are touched incoherently: no readahead
+    madvise(const_cast<char*>(base) + header->triangle_offset, mapping_size - header->triangle_offset, MADV_RANDOM);
+
+    // Keep the top of the tree resident; fall back to a prefetch hint when mlock is not permitted
+    size_t resident_bytes = std::min<size_t>(alignUp(resident_nodes * sizeof(PagedNode)), mapping_size - header->node_offset);
+    void* resident_begin = const_cast<char*>(base) + header->node_offset;
+    if (mlock(resident_begin, resident_bytes) != 0) {
+        madvise(resident_begin, resident_bytes, MADV_WILLNEED);
+    }
+
+    return true;
+}
+
+void PagedMesh::close() {
+    if (mapping) munmap(mapping, mapping_size);
+    if (fd >= 0) ::close(fd);
+
+    fd = -1;
+    mapping = nullptr;
+    mapping_size = 0;
+    nodes = nullptr;
+    triangles = nullptr;
+    node_count = triangle_count = resident_nodes = 0;
+}
+
+bool PagedMesh::intersect(const Ray& ray, float& t, uint32_t& triangle_index) const {
+    if (!nodes || node_count == 0) return false;
+
+    Vec3 inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    t = std::numeric_limits<float>::max();
+    bool hit = false;
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    float t_entry;
+    if (!intersectBox(nodes[0], ray.origin, inv_dir, t, t_entry)) return false;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        uint32_t index = stack[--stack_size];
+        const PagedNode& node = nodes[index];
+
+        // Children always follow their parent, so a damaged file can neither read past the
+        // sections nor send the traversal around a cycle; such nodes are skipped
+        if (node.count > 0) {
+            if (node.offset > triangle_count || node.count > triangle_count - node.offset) continue;
+            for (uint32_t i = 0; i < node.count; ++i) {
+                float t_tri;
+                if (intersectTriangle(triangles[node.offset + i], ray, t_tri) && t_tri < t) {
+                    t = t_tri;
+                    triangle_index = node.offset + i;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        if (node.offset <= index || node.offset >= node_count - 1 || stack_size > 62) continue;
+
+        float t_left, t_right;
+        bool hit_left = intersectBox(nodes[node.offset], ray.origin, inv_dir, t, t_left);
+        bool hit_right = intersectBox(nodes[node.offset + 1], ray.origin, inv_dir, t, t_right);
+
+        // Push the far child first so the near one is visited next
+        if (hit_left && hit_right) {
+            bool left_first = t_left <= t_right;
+            stack[stack_size++] = node.offset + (left_first ? 1 : 0);
+            stack[stack_size++] = node.offset + (left_first ? 0 : 1);
+        } else if (hit_left) {
+            stack[stack_size++] = node.offset;
+        } else if (hit_right) {
+            stack[stack_size++] = node.offset + 1;
+        }
+    }
+
+    return hit;
+}
+
+bool PagedMesh::intersect(const Ray& ray, float& t, std::optional<Triangle>& hit, const Material& material) const {
+    uint32_t index;
+    if (!intersect(ray, t, index)) return false;
+    hit.emplace(getTriangle(index, material));
+    return true;
+}
+
+Triangle PagedMesh::getTriangle(uint32_t index, const Material& material) const {
+    const PagedTriangle& tri = triangles[index];
+    Vec3 p[3];
+    for (int k = 0; k < 3; ++k) p[k] = Vec3(tri.p[k][0], tri.p[k][1], tri.p[k][2]);
+
+    return Triangle(
+        p[0], p[1], p[2],
+        decodeOctahedral(tri.n[0]), decodeOctahedral(tri.n[1]), decodeOctahedral(tri.n[2]),
+        decodeHalf2(tri.st[0]), decodeHalf2(tri.st[1]), decodeHalf2(tri.st[2]),
+        material
+    );
+}
+
+PageStats PagedMesh::getStats() const {
+    PageStats stats = {};
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats.minor_faults = usage.ru_minflt;
+        stats.major_faults = usage.ru_majflt;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        stats.resident_set_bytes = resident_pages * page_size;
+    }
+
+    if (mapping) {
+        size_t pages = (mapping_size + page_size - 1) / page_size;
+        std::vector<unsigned char> residency(pages);
+        stats.mapped_bytes = mapping_size;
+        if (mincore(mapping, mapping_size, residency.data()) == 0) {
+            for (unsigned char page : residency) {
+                if (page & 1) stats.mapped_resident_bytes += page_size;
+            }
+            stats.mapped_resident_bytes = std::min(stats.mapped_resident_bytes, mapping_size);
+        }
+    }
+
+    return stats;
+}
+
+void PagedMesh::printStats(const std::string& label) const {
+    PageStats stats = getStats();
+    std::cout << "[pages] " << label
+              << ": minor faults " << stats.minor_faults
+              << ", major faults " << stats.major_faults
+              << ", RSS " << stats.resident_set_bytes / (1024.0 * 1024.0) << " MB"
+              << ", mapped " << stats.mapped_resident_bytes / (1024.0 * 1024.0)
+              << " / " << stats.mapped_bytes / (1024.0 * 1024.0) << " MB resident" << std::endl;
+}
@@ -0,0 +1,106 @@
+#ifndef MESH_PAGES_H
+#define MESH_PAGES_H
+
+/*
+ * Out-of-core triangle storage.
+ *
+ * A page file holds a flattened BVH and the triangles it references, with
+ * the triangles written in leaf (BVH) order so that a subtree maps onto a
+ * contiguous run of pages. The top levels of the tree are stored
+ * breadth-first at the front of the node section and pinned in memory;
+ * everything below is mapped with mmap and paged in by the OS on demand.
+ *
+ * Building never holds the mesh in memory. The OBJ is streamed into a
+ * scratch file, sorted along the Morton curve of the triangle centroids in
+ * runs of bounded size, and the runs are merged straight into the page file.
+ * The tree splits the merged order at the median down to blocks of sorted
+ * triangles, and each block gets a binned SAH tree of its own. Besides the
+ * OBJ's vertex lists, the build holds one sort run or block, a read buffer
+ * per run and the resident levels of the tree.
+ */
+
+#include "vec3.h"
+#include "geometry.h"
+#include "material.h"
+#include "mesh.h"
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct PagedNode {
+    float bmin[3];
+    float bmax[3];
+    uint32_t offset;    // First triangle for leaves, first of the two adjacent children otherwise
+    uint32_t count;     // Number of triangles, 0 for interior nodes
+};
+
+struct PagedTriangle {
+    float p[3][3];      // Vertex positions
+    uint32_t n[3];      // Octahedral vertex normals
+    uint32_t st[3];     // Half-float texture coordinates
+    uint32_t pad;
+};
+
+struct PagedMeshHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t resident_nodes;
+    uint64_t node_count;
+    uint64_t triangle_count;
+    uint64_t node_offset;
+    uint64_t triangle_offset;
+    uint64_t source_size;       // Of the mesh file the pages were built from, to detect edits
+    int64_t source_mtime_ns;
+};
+
+struct PageStats {
+    long minor_faults;
+    long major_faults;
+    size_t resident_set_bytes;
+    size_t mapped_bytes;
+    size_t mapped_resident_bytes;
+};
+
+class PagedMesh {
+public:
+    PagedMesh() = default;
+    ~PagedMesh();
+
+    PagedMesh(const PagedMesh&) = delete;
+    PagedMesh& operator=(const PagedMesh&) = delete;
+
+    // Builds a page file from the OBJ at `source_path`
+    static bool build(const std::string& path, const std::string& source_path, int resident_levels);
+    // Whether `path` is a page file of this version built from `source_path` as it is now;
+    // a source that cannot be found leaves an existing page file current
+    static bool isCurrent(const std::string& path, const std::string& source_path);
+
+    bool open(const std::string& path);
+    void close();
+
+    bool intersect(const Ray& ray, float& t, uint32_t& triangle_index) const;
+    bool intersect(const Ray& ray, float& t, std::optional<Triangle>& hit, const Material& material) const;
+
+    Triangle getTriangle(uint32_t index, const Material& material) const;
+
+    size_t getTriangleCount() const { return triangle_count; }
+    size_t getResidentNodeCount() const { return resident_nodes; }
+
+    PageStats getStats() const;
+    void printStats(const std::string& label) const;
+
+private:
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+
+    const PagedNode* nodes = nullptr;
+    const PagedTriangle* triangles = nullptr;
+    size_t node_count = 0;
+    size_t triangle_count = 0;
+    size_t resident_nodes = 0;
+};
+
+#endif // MESH_PAGES_H
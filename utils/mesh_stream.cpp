@@ -0,0 +1,89 @@
+#include "mesh_stream.h"
+#include "mapped_file.h"
+#include "obj_parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+    const size_t PARSE_CHUNK_BYTES = 1 << 20;
+
+    MeshVertex toVertex(const ObjData& data, const std::array<int, 3>& corner) {
+        MeshVertex vertex = {};
+        std::memcpy(vertex.position, data.vertices[corner[0]].data(), sizeof(vertex.position));
+        if (corner[1] != -1) std::memcpy(vertex.uv, data.textures[corner[1]].data(), sizeof(vertex.uv));
+        if (corner[2] != -1) std::memcpy(vertex.normal, data.normals[corner[2]].data(), sizeof(vertex.normal));
+        return vertex;
+    }
+}
+
+bool streamObjTriangles(const std::string& path, size_t batch_triangles, unsigned workers, size_t queue_depth,
+                        const std::function<void(TriangleBatch&)>& consume, StreamStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(path, true)) {
+        std::cerr << "Could not open mesh file: " << path << std::endl;
+        return false;
+    }
+
+    if (workers == 0) workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    batch_triangles = std::max<size_t>(1, batch_triangles);
+    stats = StreamStats();
+    stats.bytes = file.size();
+
+    BoundedQueue<TriangleBatch> queue(std::max<size_t>(1, queue_depth));
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; ++i) {
+        threads.emplace_back([&]() {
+            TriangleBatch batch;
+            while (queue.pop(batch)) consume(batch);
+        });
+    }
+
+    TriangleBatch batch{0, {}};
+    batch.triangles.reserve(batch_triangles);
+    auto flush = [&]() {
+        stats.triangles += batch.triangles.size();
+        ++stats.batches;
+        queue.push(std::move(batch));
+        batch = TriangleBatch{stats.batches, {}};
+        batch.triangles.reserve(batch_triangles);
+    };
+
+    ObjData data;
+    const char* end = file.data() + file.size();
+    for (const char* chunk = file.data(); chunk < end;) {
+        const char* chunk_end = chunk + std::min(PARSE_CHUNK_BYTES, static_cast<size_t>(end - chunk));
+        if (chunk_end < end) {
+            const char* newline = static_cast<const char*>(std::memchr(chunk_end, '\n', end - chunk_end));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        parseObj(chunk, chunk_end, data);
+
+        // Only the vertex lists are needed by later chunks, the faces go out right away
+        for (size_t f = 0; f < data.faceCount(); ++f) {
+            const std::array<int, 3>* face = &data.corners[data.face_offsets[f]];
+            size_t face_size = data.face_offsets[f + 1] - data.face_offsets[f];
+            for (size_t i = 1; i + 1 < face_size; ++i) {
+                MeshTriangle triangle;
+                triangle.corners[0] = toVertex(data, face[0]);
+                triangle.corners[1] = toVertex(data, face[i]);
+                triangle.corners[2] = toVertex(data, face[i + 1]);
+                batch.triangles.push_back(triangle);
+                if (batch.triangles.size() == batch_triangles) flush();
+            }
+        }
+        data.corners.clear();
+        data.face_offsets.assign(1, 0);
+        chunk = chunk_end;
+    }
+    if (!batch.triangles.empty()) flush();
+    stats.parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    queue.close();
+    for (auto& thread : threads) thread.join();
+    stats.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef MESH_STREAM_H
+#define MESH_STREAM_H
+
+/*
+ * Streaming OBJ ingestion.
+ *
+ * The file is parsed front to back in line-aligned chunks on the calling
+ * thread. Faces only reference elements defined before them, so each
+ * chunk's faces are triangulated as soon as it is parsed and handed in
+ * batches, through a bounded queue, to worker threads. Consumers such as
+ * bottom-level tree builders therefore run while the rest of the file is
+ * still being read, and only the vertex lists and the queued batches are
+ * ever held in memory.
+ */
+
+#include "mesh.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TriangleBatch {
+    size_t index;                           // Position of the batch in file order
+    std::vector<MeshTriangle> triangles;
+};
+
+// Blocking FIFO holding at most `capacity` items
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+struct StreamStats {
+    size_t bytes = 0;
+    size_t triangles = 0;
+    size_t batches = 0;
+    double parse_seconds = 0.0;     // Until the last batch was queued
+    double total_seconds = 0.0;     // Until every batch was consumed
+};
+
+// Streams the triangles of an OBJ file to `consume`, which runs on `workers` threads (0 = one per
+// remaining hardware thread) while at most `queue_depth` batches of `batch_triangles` wait
+bool streamObjTriangles(const std::string& path, size_t batch_triangles, unsigned workers, size_t queue_depth,
+                        const std::function<void(TriangleBatch&)>& consume, StreamStats& stats);
+
+#endif // MESH_STREAM_H
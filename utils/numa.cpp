@@ -0,0 +1,146 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    const int MAX_NODES = 1024;
+    const int MASK_WORDS = MAX_NODES / (8 * sizeof(unsigned long));
+
+    // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+    std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        size_t position = 0;
+        while (position < list.size()) {
+            size_t end = list.find(',', position);
+            if (end == std::string::npos) end = list.size();
+            std::string range = list.substr(position, end - position);
+            size_t dash = range.find('-');
+            if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+                int first = std::atoi(range.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+                for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            }
+            position = end + 1;
+        }
+        return cpus;
+    }
+}
+
+const NumaTopology& NumaTopology::get() {
+    static NumaTopology topology;
+    return topology;
+}
+
+NumaTopology::NumaTopology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (int cpu = 0; cpu < static_cast<int>(std::thread::hardware_concurrency()); ++cpu) CPU_SET(cpu, &allowed);
+    }
+
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    if (DIR* directory = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(directory)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 || name[4] < '0' || name[4] > '9') continue;
+
+            std::ifstream file("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            std::getline(file, list);
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(list)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) nodes.emplace_back(std::atoi(name.c_str() + 4), cpus);
+        }
+        closedir(directory);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    for (auto& [id, cpus] : nodes) {
+        node_ids.push_back(id);
+        node_cpus.push_back(cpus);
+    }
+    if (node_cpus.empty()) {
+        node_ids.push_back(0);
+        node_cpus.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) node_cpus[0].push_back(cpu);
+        }
+    }
+}
+
+int NumaTopology::findNode(int id) const {
+    auto it = std::find(node_ids.begin(), node_ids.end(), id);
+    return it == node_ids.end() ? -1 : static_cast<int>(it - node_ids.begin());
+}
+
+bool pinThreadToCpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool pinThreadToNode(int node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : NumaTopology::get().getCpus(node)) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+void runOnNode(int node, const std::function<void()>& work) {
+    std::thread thread([&]() {
+        pinThreadToNode(node);
+        work();
+    });
+    thread.join();
+}
+
+InterleavedAllocation::InterleavedAllocation() {
+    const NumaTopology& topology = NumaTopology::get();
+    if (topology.getNodeCount() < 2) return;
+
+    unsigned long mask[MASK_WORDS] = {};
+    for (int node = 0; node < topology.getNodeCount(); ++node) {
+        int id = topology.getNodeId(node);
+        if (id < MAX_NODES) mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+    }
+    active = syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask, MAX_NODES + 1) == 0;
+}
+
+InterleavedAllocation::~InterleavedAllocation() {
+    if (active) syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+}
+
+std::vector<int> pageNodes(const std::vector<const void*>& addresses) {
+    std::vector<int> nodes(addresses.size(), -1);
+    if (addresses.empty()) return nodes;
+
+    uintptr_t page_mask = ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+    std::vector<void*> pages(addresses.size());
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        pages[i] = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(addresses[i]) & page_mask);
+    }
+
+    // Without target nodes, move_pages only reports where each page is
+    std::vector<int> status(addresses.size(), -1);
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) return nodes;
+
+    const NumaTopology& topology = NumaTopology::get();
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        if (status[i] >= 0) nodes[i] = topology.findNode(status[i]);
+    }
+    return nodes;
+}
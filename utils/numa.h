@@ -0,0 +1,61 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+/*
+ * NUMA placement
+ *
+ * The topology is read from /sys/devices/system/node. A machine without it
+ * counts as one node holding every CPU the process may run on. Memory
+ * policies and page queries use the raw system calls, so only the kernel
+ * headers are needed and nothing is linked in.
+ *
+ * Linux places a page on the node of the thread that first writes it.
+ * Pinned threads therefore get local memory by building or writing their
+ * data themselves; InterleavedAllocation spreads it over all nodes instead.
+ */
+
+#include <functional>
+#include <vector>
+
+class NumaTopology {
+public:
+    static const NumaTopology& get();
+
+    int getNodeCount() const { return static_cast<int>(node_cpus.size()); }
+    const std::vector<int>& getCpus(int node) const { return node_cpus[node]; }
+
+    // Nodes are numbered densely here; the kernel's ids can have gaps
+    int getNodeId(int node) const { return node_ids[node]; }
+    int findNode(int id) const;
+
+private:
+    std::vector<int> node_ids;
+    std::vector<std::vector<int>> node_cpus;   // Only CPUs the process may run on; nodes without any are dropped
+
+    NumaTopology();
+};
+
+// Restrict the calling thread to one CPU, or to the CPUs of one node
+bool pinThreadToCpu(int cpu);
+bool pinThreadToNode(int node);
+
+// Runs `work` on a new thread pinned to `node` and waits for it, so the memory it writes first is local to the node
+void runOnNode(int node, const std::function<void()>& work);
+
+// While alive, pages first touched by the calling thread are spread round-robin over all nodes
+class InterleavedAllocation {
+public:
+    InterleavedAllocation();
+    ~InterleavedAllocation();
+
+    InterleavedAllocation(const InterleavedAllocation&) = delete;
+    InterleavedAllocation& operator=(const InterleavedAllocation&) = delete;
+
+private:
+    bool active = false;
+};
+
+// Node holding the page of each address, -1 where the kernel cannot tell (not yet touched, no NUMA support)
+std::vector<int> pageNodes(const std::vector<const void*>& addresses);
+
+#endif // NUMA_H
@@ -0,0 +1,172 @@
+#include "obj_parser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <thread>
+
+namespace {
+    inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) ++p;
+        return p;
+    }
+
+    inline const char* skipLine(const char* p, const char* end) {
+        while (p < end && *p != '\n') ++p;
+        return p < end ? p + 1 : end;
+    }
+
+    inline const char* parseFloat(const char* p, const char* end, float& value) {
+        p = skipBlanks(p, end);
+        if (p < end && *p == '+') ++p;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) value = 0.0f;
+        return result.ptr;
+    }
+
+    // Files smaller than this are not worth splitting
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    // OBJ indices are 1-based, negative values count back from the latest element
+    inline const char* parseIndex(const char* p, const char* end, size_t count, int& index, bool& relative) {
+        int raw = 0;
+        auto result = std::from_chars(p, end, raw);
+        if (result.ec != std::errc() || raw == 0) {
+            index = -1;
+            return result.ec != std::errc() ? p : result.ptr;
+        }
+        relative = raw < 0;
+        index = raw > 0 ? raw - 1 : static_cast<int>(count) + raw;
+        return result.ptr;
+    }
+
+    template <std::size_t N>
+    const char* parseVector(const char* p, const char* end, std::vector<std::array<float, N>>& out) {
+        std::array<float, N> values;
+        for (std::size_t i = 0; i < N; ++i) p = parseFloat(p, end, values[i]);
+        out.push_back(values);
+        return p;
+    }
+
+    const char* parseFace(const char* p, const char* end, ObjData& data, std::vector<size_t>* relative) {
+        while (true) {
+            p = skipBlanks(p, end);
+            if (p >= end || *p == '\n' || *p == '#') break;
+
+            std::array<int, 3> corner = {-1, -1, -1};
+            bool is_relative[3] = {false, false, false};
+            const char* next = parseIndex(p, end, data.vertices.size(), corner[0], is_relative[0]);
+            if (next == p) break; // Not an index: ignore the rest of the line
+            p = next;
+
+            if (p < end && *p == '/') {
+                ++p;
+                if (p < end && *p != '/') p = parseIndex(p, end, data.textures.size(), corner[1], is_relative[1]);
+                if (p < end && *p == '/') {
+                    ++p;
+                    p = parseIndex(p, end, data.normals.size(), corner[2], is_relative[2]);
+                }
+            }
+
+            if (relative) {
+                for (int k = 0; k < 3; ++k) {
+                    if (is_relative[k]) relative->push_back(data.corners.size() * 3 + k);
+                }
+            }
+            data.corners.push_back(corner);
+        }
+        data.face_offsets.push_back(static_cast<uint32_t>(data.corners.size()));
+        return p;
+    }
+}
+
+void parseObj(const char* begin, const char* end, ObjData& data, std::vector<size_t>* relative) {
+    const char* p = begin;
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (p + 1 < end && p[0] == 'v' && isBlank(p[1])) {
+            p = parseVector(p + 2, end, data.vertices);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+            p = parseVector(p + 3, end, data.textures);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+            p = parseVector(p + 3, end, data.normals);
+        } else if (p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+            p = parseFace(p + 2, end, data, relative);
+        }
+        p = skipLine(p, end);
+    }
+}
+
+void parseObjParallel(const char* begin, const char* end, ObjData& data, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t size = static_cast<size_t>(end - begin);
+    size_t chunk_count = std::min<size_t>(threads, std::max<size_t>(1, size / MIN_CHUNK_BYTES));
+    if (chunk_count <= 1) {
+        parseObj(begin, end, data);
+        return;
+    }
+
+    // Chunk boundaries land just after a newline
+    std::vector<const char*> bounds(chunk_count + 1, end);
+    bounds[0] = begin;
+    for (size_t c = 1; c < chunk_count; ++c) {
+        const char* p = std::max(begin + size * c / chunk_count, bounds[c - 1]);
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        bounds[c] = newline ? newline + 1 : end;
+    }
+
+    std::vector<ObjData> chunks(chunk_count);
+    std::vector<std::vector<size_t>> relative(chunk_count);
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < chunk_count; ++c) {
+        workers.emplace_back([&, c]() { parseObj(bounds[c], bounds[c + 1], chunks[c], &relative[c]); });
+    }
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    // Prefix sums give every chunk its place in the merged arrays
+    struct Offsets { size_t vertices, normals, textures, corners, faces; };
+    std::vector<Offsets> offsets(chunk_count + 1, Offsets{0, 0, 0, 0, 0});
+    for (size_t c = 0; c < chunk_count; ++c) {
+        offsets[c + 1].vertices = offsets[c].vertices + chunks[c].vertices.size();
+        offsets[c + 1].normals = offsets[c].normals + chunks[c].normals.size();
+        offsets[c + 1].textures = offsets[c].textures + chunks[c].textures.size();
+        offsets[c + 1].corners = offsets[c].corners + chunks[c].corners.size();
+        offsets[c + 1].faces = offsets[c].faces + chunks[c].faceCount();
+    }
+
+    const Offsets& total = offsets[chunk_count];
+    data.vertices.resize(total.vertices);
+    data.normals.resize(total.normals);
+    data.textures.resize(total.textures);
+    data.corners.resize(total.corners);
+    data.face_offsets.resize(total.faces + 1);
+    data.face_offsets[0] = 0;
+
+    for (size_t c = 0; c < chunk_count; ++c) {
+        workers.emplace_back([&, c]() {
+            ObjData& chunk = chunks[c];
+            const Offsets& base = offsets[c];
+
+            // Negative indices were resolved against this chunk's own counts
+            size_t element_base[3] = {base.vertices, base.textures, base.normals};
+            for (size_t slot : relative[c]) {
+                chunk.corners[slot / 3][slot % 3] += static_cast<int>(element_base[slot % 3]);
+            }
+
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), data.vertices.begin() + base.vertices);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + base.normals);
+            std::copy(chunk.textures.begin(), chunk.textures.end(), data.textures.begin() + base.textures);
+            std::copy(chunk.corners.begin(), chunk.corners.end(), data.corners.begin() + base.corners);
+            for (size_t f = 1; f < chunk.face_offsets.size(); ++f) {
+                data.face_offsets[base.faces + f] = static_cast<uint32_t>(base.corners + chunk.face_offsets[f]);
+            }
+
+            chunk = ObjData();
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
@@ -0,0 +1,33 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Wavefront OBJ geometry. Faces are stored flat: face f spans
+ * corners[face_offsets[f] .. face_offsets[f + 1]), and every corner holds
+ * 0-based v/vt/vn indices with -1 for a missing attribute.
+ */
+struct ObjData {
+    std::vector<std::array<float, 3>> vertices;
+    std::vector<std::array<float, 3>> normals;
+    std::vector<std::array<float, 2>> textures;
+    std::vector<std::array<int, 3>> corners;
+    std::vector<uint32_t> face_offsets{0};
+
+    size_t faceCount() const { return face_offsets.size() - 1; }
+};
+
+// Parses the v/vt/vn/f records of an in-memory OBJ file in place, without per-line allocations.
+// When `relative` is given, negative OBJ indices are resolved against the counts seen so far in
+// this range and their slots (corner * 3 + attribute) are recorded so a caller can rebase them.
+void parseObj(const char* begin, const char* end, ObjData& data, std::vector<size_t>* relative = nullptr);
+
+// Splits the file into line-aligned chunks parsed on `threads` workers (0 = hardware concurrency)
+// and merges them with prefix sums over the per-chunk counts
+void parseObjParallel(const char* begin, const char* end, ObjData& data, unsigned threads);
+
+#endif // OBJ_PARSER_H
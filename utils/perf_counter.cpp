@@ -0,0 +1,37 @@
+#include "perf_counter.h"
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+CacheMissCounter::CacheMissCounter(CacheEvent event) {
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    if (event == CacheEvent::L1DataReadMisses) {
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    } else {
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    }
+    attributes.disabled = 1;
+    attributes.inherit = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+CacheMissCounter::~CacheMissCounter() {
+    if (fd >= 0) close(fd);
+}
+
+uint64_t CacheMissCounter::read() const {
+    uint64_t count = 0;
+    if (fd < 0 || ::read(fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count))) return 0;
+    return count;
+}
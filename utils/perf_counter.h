@@ -0,0 +1,41 @@
+#ifndef PERF_COUNTER_H
+#define PERF_COUNTER_H
+
+/*
+ * Hardware event counts through perf_event_open
+ *
+ * A counter covers the thread that opens it and every thread that thread
+ * starts while it is open; the counts of those threads are added in once
+ * they exit. To count a whole render, open the counter, create a TaskPool,
+ * render and destroy the pool before reading.
+ *
+ * Kernels with perf_event_paranoid set high, most containers and virtual
+ * machines without a virtual PMU refuse the counters; isAvailable() is
+ * false then and read() gives 0.
+ */
+
+#include <cstdint>
+
+enum class CacheEvent {
+    L1DataReadMisses,
+    LastLevelMisses
+};
+
+class CacheMissCounter {
+public:
+    explicit CacheMissCounter(CacheEvent event);
+    ~CacheMissCounter();
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    bool isAvailable() const { return fd >= 0; }
+
+    // Events since the counter was opened
+    uint64_t read() const;
+
+private:
+    int fd = -1;
+};
+
+#endif // PERF_COUNTER_H
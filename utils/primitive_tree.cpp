@@ -8,6 +8,15 @@ const int MAX_DEPTH = 20;
 const size_t MIN_PRIMITIVES_PER_LEAF = 4;
 
 namespace {
+    void offsetLeaves(PrimitiveNode* node, size_t offset) {
+        if (node->isLeaf()) {
+            node->primitive_start_index += offset;
+            return;
+        }
+        offsetLeaves(node->left.get(), offset);
+        offsetLeaves(node->right.get(), offset);
+    }
+
     float calculateSAH(const BoundingBox& left_bbox, const BoundingBox& right_bbox, int numLeft, int numRight, const BoundingBox& parent_bbox) {
         /*
         Surface Area Heuristic (SAH) cost.
@@ -70,6 +79,41 @@ PrimitiveTree::PrimitiveTree(std::vector<Primitive*>& primitives_list)
     }
 }
 
+PrimitiveTree::PrimitiveTree(std::vector<Primitive*>& primitives_list, std::vector<std::shared_ptr<PrimitiveNode>> subtrees, const std::vector<size_t>& offsets)
+    : all_primitives(primitives_list) {
+    std::vector<std::shared_ptr<PrimitiveNode>> roots;
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+        if (!subtrees[i]) continue;
+        offsetLeaves(subtrees[i].get(), offsets[i]);
+        roots.push_back(subtrees[i]);
+    }
+    root = roots.empty() ? nullptr : buildTop(roots, 0, roots.size());
+}
+
+// Median split of the subtree roots along the widest axis of their centers
+std::shared_ptr<PrimitiveNode> PrimitiveTree::buildTop(std::vector<std::shared_ptr<PrimitiveNode>>& subtrees, size_t start, size_t end) {
+    if (end - start == 1) return subtrees[start];
+
+    auto node = std::make_shared<PrimitiveNode>();
+    BoundingBox centroid_bounds = BoundingBox();
+    for (size_t i = start; i < end; ++i) {
+        node->bbox = node->bbox.expand(subtrees[i]->bbox);
+        centroid_bounds.expand(subtrees[i]->bbox.center());
+    }
+
+    int axis = centroid_bounds.getLongestAxis();
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(subtrees.begin() + start, subtrees.begin() + mid, subtrees.begin() + end,
+        [axis](const std::shared_ptr<PrimitiveNode>& a, const std::shared_ptr<PrimitiveNode>& b) {
+            return a->bbox.center()[axis] < b->bbox.center()[axis];
+        }
+    );
+
+    node->left = buildTop(subtrees, start, mid);
+    node->right = buildTop(subtrees, mid, end);
+    return node;
+}
+
 std::shared_ptr<PrimitiveNode> PrimitiveTree::build(size_t start, size_t end, int depth) {
     auto node = std::make_shared<PrimitiveNode>();
     size_t num_primitives_in_node = end - start;
@@ -107,13 +151,13 @@ std::shared_ptr<PrimitiveNode> PrimitiveTree::build(size_t start, size_t end, in
         BoundingBox current_right_bbox_accum = BoundingBox();
         
         for (int i = num_primitives_in_node - 1; i >= 0; --i) {
-            current_right_bbox_accum.expand(all_primitives[start + i]->getBoundingBox());
+            current_right_bbox_accum = current_right_bbox_accum.expand(all_primitives[start + i]->getBoundingBox());
             right_accumulated_bboxes[i] = current_right_bbox_accum;
         }
 
         BoundingBox left_bbox_accum = BoundingBox();
         for (size_t i = 0; i < num_primitives_in_node - 1; ++i) {
-            left_bbox_accum.expand(all_primitives[start + i]->getBoundingBox());
+            left_bbox_accum = left_bbox_accum.expand(all_primitives[start + i]->getBoundingBox());
             
             BoundingBox right_bbox_to_consider = right_accumulated_bboxes[i + 1];
             
@@ -28,12 +28,17 @@ public:
 
     PrimitiveTree(std::vector<Primitive*>& primitives_list);
 
+    // Joins trees built separately over consecutive ranges of `primitives_list`: subtree i covers
+    // [offsets[i], offsets[i + 1]) with leaf indices relative to offsets[i]
+    PrimitiveTree(std::vector<Primitive*>& primitives_list, std::vector<std::shared_ptr<PrimitiveNode>> subtrees, const std::vector<size_t>& offsets);
+
     bool intersect(const Ray& ray, float& t, Primitive*& hitPrimitive) const;
 
 private:
     std::vector<Primitive*>& all_primitives; 
 
     std::shared_ptr<PrimitiveNode> build(size_t start, size_t end, int depth);
+    std::shared_ptr<PrimitiveNode> buildTop(std::vector<std::shared_ptr<PrimitiveNode>>& subtrees, size_t start, size_t end);
     
     bool intersectNode(const std::shared_ptr<PrimitiveNode> node, const Ray& ray, float& t, Primitive*& hitPrimitive) const;
 };
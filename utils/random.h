@@ -0,0 +1,68 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/*
+ * Counter-based random numbers
+ *
+ * Philox-2x32-10 (Salmon et al. 2011) maps a key and a 64-bit counter to
+ * two random words with no state in between, so any number of a stream
+ * can be computed directly, by any thread and in any order.
+ *
+ * SampleStream keys the generator with a pixel and puts the sample index
+ * and the dimension (the how-many-th number the sample has drawn) in the
+ * counter. Each sample of a pixel is its own stream, so any thread can
+ * trace any sample without drawing the numbers of the samples before it,
+ * and a pixel sees the same numbers whatever order its samples and tile
+ * are scheduled in.
+ */
+
+#include <cstdint>
+
+inline void philox2x32(uint32_t key, uint32_t& c0, uint32_t& c1) {
+    const uint32_t MULTIPLIER = 0xD256D193u;
+    const uint32_t WEYL = 0x9E3779B9u;
+    for (int round = 0; round < 10; ++round) {
+        uint64_t product = static_cast<uint64_t>(MULTIPLIER) * c0;
+        uint32_t high = static_cast<uint32_t>(product >> 32);
+        uint32_t low = static_cast<uint32_t>(product);
+        c0 = high ^ key ^ c1;
+        c1 = low;
+        key += WEYL;
+    }
+}
+
+// Top 24 bits of a word as a float in [0, 1)
+inline float uintToUnitFloat(uint32_t bits) {
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+class SampleStream {
+public:
+    SampleStream(uint32_t pixel, uint32_t sample) : pixel(pixel), sample(sample) {}
+
+    uint32_t getPixel() const { return pixel; }
+
+    // Next dimension, uniform in [0, 1). Uses the first of the two words a call makes and
+    // discards the second; next2D() uses both.
+    float next1D() {
+        uint32_t c0 = dimension++, c1 = sample;
+        philox2x32(pixel, c0, c1);
+        return uintToUnitFloat(c0);
+    }
+
+    // Next two dimensions from one generator call
+    void next2D(float& u, float& v) {
+        uint32_t c0 = dimension, c1 = sample;
+        dimension += 2;
+        philox2x32(pixel, c0, c1);
+        u = uintToUnitFloat(c0);
+        v = uintToUnitFloat(c1);
+    }
+
+private:
+    uint32_t pixel;
+    uint32_t sample;
+    uint32_t dimension = 0;
+};
+
+#endif // RANDOM_H
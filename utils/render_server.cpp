@@ -0,0 +1,463 @@
+#include "render_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    const size_t MAX_REQUEST_BYTES = 1 << 16;
+    const int MAX_IMAGE_SIZE = 16384;       // Per side
+    const int MAX_SAMPLES = 1024;
+    const int REQUEST_TIMEOUT_S = 10;       // For a client to send its request line
+    const int REPLY_TIMEOUT_S = 30;         // For a client to take each part of the reply
+    const int POLL_INTERVAL_MS = 250;
+
+    using Clock = std::chrono::steady_clock;
+
+    double milliseconds(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    bool writeAll(int fd, const void* data, size_t bytes) {
+        const char* position = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t written = send(fd, position, bytes, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            position += written;
+            bytes -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool writeLine(int fd, const std::string& line) {
+        std::string text = line + "\n";
+        return writeAll(fd, text.data(), text.size());
+    }
+
+    bool readAll(int fd, void* data, size_t bytes) {
+        char* position = static_cast<char*>(data);
+        while (bytes > 0) {
+            ssize_t received = recv(fd, position, bytes, 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+            position += received;
+            bytes -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // Byte by byte, so nothing after the newline is consumed
+    bool readLine(int fd, std::string& line) {
+        line.clear();
+        char c;
+        while (line.size() < MAX_REQUEST_BYTES) {
+            if (!readAll(fd, &c, 1)) return false;
+            if (c == '\n') return true;
+            line += c;
+        }
+        return false;
+    }
+
+    bool makeAddress(const std::string& path, sockaddr_un& address, std::string& error) {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            error = "Socket path is empty or too long: " + path;
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    int connectTo(const std::string& path, std::string& error) {
+        sockaddr_un address;
+        if (!makeAddress(path, address, error)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            error = "Cannot reach a render server at " + path + ": " + std::strerror(errno);
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool parseInt(const std::string& text, int minimum, int maximum, int& value) {
+        char* end;
+        errno = 0;
+        long parsed = std::strtol(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno != 0 || parsed < minimum || parsed > maximum) return false;
+        value = static_cast<int>(parsed);
+        return true;
+    }
+
+    bool parseVec3(const std::string& text, Vec3& value) {
+        float x, y, z;
+        int consumed = 0;
+        if (std::sscanf(text.c_str(), "%f,%f,%f%n", &x, &y, &z, &consumed) != 3 || consumed != static_cast<int>(text.size())) return false;
+        value = Vec3(x, y, z);
+        return true;
+    }
+
+    std::string formatVec3(const Vec3& value) {
+        std::ostringstream text;
+        text << std::setprecision(9) << value[0] << "," << value[1] << "," << value[2];
+        return text.str();
+    }
+
+    struct Outcome {
+        std::unique_ptr<Film> film;
+        std::string error;
+        RenderJobReport report;
+    };
+
+    struct QueuedJob {
+        RenderJob job;
+        RenderJobReport report;
+        Clock::time_point arrival;
+        std::promise<Outcome> outcome;
+    };
+
+    struct ServerState {
+        std::mutex mutex;
+        std::condition_variable changed;
+        // Highest priority first, then oldest
+        std::map<std::pair<int, unsigned long long>, std::shared_ptr<QueuedJob>> queue;
+        std::atomic<bool> stopping{false};
+        int connections = 0;
+
+        unsigned long long next_id = 0;
+        unsigned long long completed = 0;
+        unsigned long long failed = 0;
+        size_t max_queued = 0;
+        double total_wait_ms = 0.0;
+        double total_render_ms = 0.0;
+        double max_latency_ms = 0.0;
+        Clock::time_point started = Clock::now();
+    };
+
+    std::string statsLine(ServerState& state, const RenderServer::StatusFunction& status) {
+        std::ostringstream line;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            unsigned long long finished = std::max(1ULL, state.completed + state.failed);
+            line << std::fixed << std::setprecision(1)
+                 << "jobs=" << state.completed << " failed=" << state.failed
+                 << " queued=" << state.queue.size() << " max_queued=" << state.max_queued
+                 << " mean_wait_ms=" << state.total_wait_ms / finished
+                 << " mean_render_ms=" << state.total_render_ms / finished
+                 << " max_latency_ms=" << state.max_latency_ms
+                 << " uptime_s=" << std::chrono::duration<double>(Clock::now() - state.started).count();
+        }
+        if (status) line << " " << status();
+        return line.str();
+    }
+
+    void serveConnection(ServerState& state, const RenderServer::StatusFunction& status, int fd) {
+        // Bounds how long a client that goes quiet can hold this thread, reading or writing
+        timeval timeout{REQUEST_TIMEOUT_S, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        timeval reply_timeout{REPLY_TIMEOUT_S, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &reply_timeout, sizeof(reply_timeout));
+
+        std::string line;
+        if (!readLine(fd, line)) return;
+        std::string command;
+        std::istringstream(line) >> command;
+
+        if (command == "render") {
+            auto queued = std::make_shared<QueuedJob>();
+            std::string error;
+            if (!parseRenderJob(line, queued->job, error)) {
+                writeLine(fd, "error " + error);
+                return;
+            }
+            std::future<Outcome> result = queued->outcome.get_future();
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.stopping) {
+                    writeLine(fd, "error The render server is stopping");
+                    return;
+                }
+                queued->report.id = ++state.next_id;
+                queued->report.queued_ahead = state.queue.size();
+                queued->arrival = Clock::now();
+                state.queue[{-queued->job.priority, queued->report.id}] = queued;
+                state.max_queued = std::max(state.max_queued, state.queue.size());
+            }
+            state.changed.notify_all();
+
+            Outcome outcome = result.get();
+            if (!outcome.film) {
+                writeLine(fd, "error " + outcome.error);
+                return;
+            }
+            const Film& film = *outcome.film;
+            std::ostringstream header;
+            header << std::fixed << std::setprecision(3) << "ok " << film.getWidth() << " " << film.getHeight()
+                   << " " << outcome.report.id << " " << outcome.report.wait_ms << " " << outcome.report.render_ms
+                   << " " << outcome.report.queued_ahead;
+            if (writeLine(fd, header.str())) {
+                writeAll(fd, film.getPixels(), static_cast<size_t>(film.getWidth()) * film.getHeight() * 3);
+            }
+        } else if (command == "stats") {
+            writeLine(fd, "ok " + statsLine(state, status));
+        } else if (command == "stop") {
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.stopping = true;
+            }
+            state.changed.notify_all();
+            writeLine(fd, "ok");
+        } else {
+            writeLine(fd, "error Unknown request: " + command);
+        }
+    }
+}
+
+std::string formatRenderJob(const RenderJob& job) {
+    std::ostringstream line;
+    line << "render";
+    if (!job.mesh_path.empty()) line << " mesh=" << job.mesh_path;
+    if (!job.texture_path.empty()) line << " texture=" << job.texture_path;
+    line << " width=" << job.width << " height=" << job.height
+         << " camera=" << formatVec3(job.camera) << " target=" << formatVec3(job.target)
+         << " integrator=" << job.integrator << " spp=" << job.samples << " priority=" << job.priority;
+    return line.str();
+}
+
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error) {
+    std::istringstream words(line);
+    std::string word;
+    if (!(words >> word) || word != "render") {
+        error = "Not a render request";
+        return false;
+    }
+
+    while (words >> word) {
+        size_t equals = word.find('=');
+        std::string key = word.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : word.substr(equals + 1);
+
+        bool valid = !value.empty();
+        if (key == "mesh") {
+            job.mesh_path = value;
+        } else if (key == "texture") {
+            job.texture_path = value;
+        } else if (key == "width") {
+            valid = valid && parseInt(value, 1, MAX_IMAGE_SIZE, job.width);
+        } else if (key == "height") {
+            valid = valid && parseInt(value, 1, MAX_IMAGE_SIZE, job.height);
+        } else if (key == "camera") {
+            valid = valid && parseVec3(value, job.camera);
+        } else if (key == "target") {
+            valid = valid && parseVec3(value, job.target);
+        } else if (key == "integrator") {
+            job.integrator = value;
+        } else if (key == "spp") {
+            valid = valid && parseInt(value, 1, MAX_SAMPLES, job.samples);
+        } else if (key == "priority") {
+            valid = valid && parseInt(value, -1000000, 1000000, job.priority);
+        } else {
+            error = "Unknown job key: " + key;
+            return false;
+        }
+        if (!valid) {
+            error = "Bad value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+RenderServer::RenderServer(RenderFunction render, StatusFunction status)
+    : render(std::move(render)), status(std::move(status)) {}
+
+bool RenderServer::serve(const std::string& socket_path) {
+    sockaddr_un address;
+    std::string error;
+    if (!makeAddress(socket_path, address, error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    // A socket left behind by a server that died is replaced; a live server or any other file is not
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        int probe = connectTo(socket_path, error);
+        if (probe >= 0 || !S_ISSOCK(existing.st_mode)) {
+            if (probe >= 0) close(probe);
+            std::cerr << socket_path << " is in use" << std::endl;
+            return false;
+        }
+        unlink(socket_path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        if (listen_fd >= 0) close(listen_fd);
+        return false;
+    }
+    std::cout << "Render server listening on " << socket_path << std::endl;
+
+    ServerState state;
+
+    std::thread renderer([&]() {
+        for (;;) {
+            std::shared_ptr<QueuedJob> queued;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.changed.wait(lock, [&]() { return !state.queue.empty() || state.stopping; });
+                if (state.queue.empty()) break;
+                queued = state.queue.begin()->second;
+                state.queue.erase(state.queue.begin());
+            }
+
+            Outcome outcome;
+            Clock::time_point start = Clock::now();
+            // A job that throws (e.g. out of memory for its film) fails alone instead of ending the server
+            try {
+                outcome.film = render(queued->job, outcome.error);
+            } catch (const std::exception& e) {
+                outcome.film.reset();
+                outcome.error = std::string("render failed: ") + e.what();
+            }
+            Clock::time_point end = Clock::now();
+            outcome.report = queued->report;
+            outcome.report.wait_ms = milliseconds(queued->arrival, start);
+            outcome.report.render_ms = milliseconds(start, end);
+
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                (outcome.film ? state.completed : state.failed)++;
+                state.total_wait_ms += outcome.report.wait_ms;
+                state.total_render_ms += outcome.report.render_ms;
+                state.max_latency_ms = std::max(state.max_latency_ms, milliseconds(queued->arrival, end));
+            }
+
+            const RenderJob& job = queued->job;
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << "Job " << outcome.report.id << " (priority " << job.priority << ", "
+                 << job.width << "x" << job.height << ", " << job.integrator << ", " << job.samples << " spp): ";
+            if (outcome.film) {
+                line << "waited " << outcome.report.wait_ms << " ms, rendered in " << outcome.report.render_ms << " ms, "
+                     << outcome.report.queued_ahead << " queued ahead";
+            } else {
+                line << "failed: " << outcome.error;
+            }
+            std::cout << line.str() << std::endl;
+            queued->outcome.set_value(std::move(outcome));
+        }
+    });
+
+    // One short-lived thread per connection; a render request holds its thread until the image is sent
+    while (!state.stopping) {
+        pollfd listening{listen_fd, POLLIN, 0};
+        if (poll(&listening, 1, POLL_INTERVAL_MS) <= 0) continue;
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.connections++;
+        }
+        std::thread([&state, this, fd]() {
+            serveConnection(state, status, fd);
+            close(fd);
+            // Notified under the lock, since serve() may return as soon as the count reaches zero
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.connections--;
+            state.changed.notify_all();
+        }).detach();
+    }
+
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    renderer.join();
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.changed.wait(lock, [&]() { return state.connections == 0; });
+    }
+    std::cout << "Render server stopped: " << statsLine(state, status) << std::endl;
+    return true;
+}
+
+bool submitRenderJob(const std::string& socket_path, const RenderJob& job, std::vector<unsigned char>& pixels,
+                     RenderJobReport& report, std::string& error) {
+    int fd = connectTo(socket_path, error);
+    if (fd < 0) return false;
+
+    std::string status;
+    if (!writeLine(fd, formatRenderJob(job)) || !readLine(fd, status)) {
+        error = "Lost the connection to the render server";
+        close(fd);
+        return false;
+    }
+
+    std::istringstream words(status);
+    std::string word;
+    words >> word;
+    if (word != "ok") {
+        error = status.size() > 6 ? status.substr(6) : status;
+        close(fd);
+        return false;
+    }
+    if (!(words >> report.width >> report.height >> report.id >> report.wait_ms >> report.render_ms >> report.queued_ahead)
+        || report.width <= 0 || report.height <= 0 || report.width > MAX_IMAGE_SIZE || report.height > MAX_IMAGE_SIZE) {
+        error = "Malformed reply from the render server: " + status;
+        close(fd);
+        return false;
+    }
+
+    pixels.resize(static_cast<size_t>(report.width) * report.height * 3);
+    bool received = readAll(fd, pixels.data(), pixels.size());
+    close(fd);
+    if (!received) error = "The render server closed the connection before the image was complete";
+    return received;
+}
+
+bool requestServerStats(const std::string& socket_path, std::string& stats, std::string& error) {
+    int fd = connectTo(socket_path, error);
+    if (fd < 0) return false;
+
+    std::string reply;
+    bool ok = writeLine(fd, "stats") && readLine(fd, reply) && reply.compare(0, 3, "ok ") == 0;
+    close(fd);
+    if (!ok) {
+        error = "No stats from the render server";
+        return false;
+    }
+    stats = reply.substr(3);
+    return true;
+}
+
+bool stopRenderServer(const std::string& socket_path, std::string& error) {
+    int fd = connectTo(socket_path, error);
+    if (fd < 0) return false;
+
+    std::string reply;
+    bool ok = writeLine(fd, "stop") && readLine(fd, reply) && reply == "ok";
+    close(fd);
+    if (!ok) error = "The render server did not acknowledge the stop request";
+    return ok;
+}
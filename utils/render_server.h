@@ -0,0 +1,83 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+/*
+ * Render server: a long-running renderer behind a Unix domain socket
+ *
+ * A client connects, sends one request line and reads one reply. The
+ * requests are
+ *
+ *   render key=value ...    queue a RenderJob; the reply is a status line
+ *                           followed by the RGB8 image
+ *   stats                   one line of job, queue and latency counters
+ *   stop                    finish the queued jobs, then exit
+ *
+ * The keys of a render request are those of formatRenderJob(); missing
+ * keys keep the RenderJob defaults. Values are single words, so paths may
+ * not contain spaces.
+ *
+ * Jobs wait in a queue ordered by priority, then by arrival, and are
+ * rendered one at a time by a single thread that owns the whole TaskPool.
+ * What a job renders is up to the RenderFunction, which is free to keep
+ * scenes loaded between jobs since it is only ever called from that thread.
+ * Each reply carries the job's time in the queue, its render time and the
+ * number of jobs queued ahead of it.
+ */
+
+#include "vec3.h"
+#include "renderer.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct RenderJob {
+    std::string mesh_path;          // Empty: the server's own mesh and texture
+    std::string texture_path;
+    int width = 320;
+    int height = 260;
+    Vec3 camera = Vec3(0.0f, 0.5f, 1.0f);
+    Vec3 target = Vec3(0.0f, 0.5f, 0.0f);
+    std::string integrator = "phong";
+    int samples = 1;                // Per pixel, rounded down to a square grid
+    int priority = 0;               // Higher runs first
+};
+
+// The render line of a job, and back; false with a message on unknown keys or malformed values
+std::string formatRenderJob(const RenderJob& job);
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error);
+
+// What the server reported about a rendered job
+struct RenderJobReport {
+    unsigned long long id = 0;
+    int width = 0;
+    int height = 0;
+    double wait_ms = 0.0;           // Queued until the render thread took it
+    double render_ms = 0.0;
+    size_t queued_ahead = 0;        // Jobs in the queue when it arrived
+};
+
+class RenderServer {
+public:
+    // Renders one job into a new film, or returns null with a message
+    using RenderFunction = std::function<std::unique_ptr<Film>(const RenderJob& job, std::string& error)>;
+    // Extra words for the stats line, e.g. "scenes=2"; called from connection threads
+    using StatusFunction = std::function<std::string()>;
+
+    RenderServer(RenderFunction render, StatusFunction status = StatusFunction());
+
+    // Listens on `socket_path` until a stop request; false if the socket cannot be set up
+    bool serve(const std::string& socket_path);
+
+private:
+    RenderFunction render;
+    StatusFunction status;
+};
+
+// Client side: each returns false with a message when the server cannot be reached or refuses
+bool submitRenderJob(const std::string& socket_path, const RenderJob& job, std::vector<unsigned char>& pixels,
+                     RenderJobReport& report, std::string& error);
+bool requestServerStats(const std::string& socket_path, std::string& stats, std::string& error);
+bool stopRenderServer(const std::string& socket_path, std::string& error);
+
+#endif // RENDER_SERVER_H
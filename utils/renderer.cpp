@@ -0,0 +1,115 @@
+#include "renderer.h"
+#include "utils.h"
+#include "tile_farm.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+Camera::Camera(const Vec3& position, int width, int height, float fov) : position(position) {
+    float scale = std::tan(fov / 2.0f);
+    float aspect = float(width) / float(height);
+    corner = Vec3(-scale * aspect, scale, -1.0f);
+    dpx = Vec3(2.0f * scale / float(height), 0.0f, 0.0f);
+    dpy = Vec3(0.0f, -2.0f * scale / float(height), 0.0f);
+}
+
+Camera::Camera(const Vec3& position, const Vec3& corner, const Vec3& dpx, const Vec3& dpy)
+    : position(position), corner(corner), dpx(dpx), dpy(dpy) {}
+
+Camera Camera::lookAt(const Vec3& position, const Vec3& target, int width, int height, float fov) {
+    float scale = std::tan(fov / 2.0f);
+    float aspect = float(width) / float(height);
+
+    Vec3 forward = (target - position).normalize();
+    Vec3 right = forward.cross(Vec3(0.0f, 1.0f, 0.0f));
+    if (right.length() < 1e-6f) right = forward.cross(Vec3(0.0f, 0.0f, -1.0f));
+    right = right.normalize();
+    Vec3 up = right.cross(forward);
+
+    return Camera(position, forward + right * (-scale * aspect) + up * scale,
+                  right * (scale * 2.0f / float(width) * aspect),
+                  up * (-scale * 2.0f / float(width)));
+}
+
+CameraRay Camera::generateRay(int x, int y, float sx, float sy) const {
+    Vec3 direction = corner + dpx * (x + sx) + dpy * (y + sy);
+
+    // Derivative of the normalized direction: (d' |d|^2 - d (d . d')) / |d|^3
+    float length_squared = direction.dot(direction);
+    float length_cubed = length_squared * std::sqrt(length_squared);
+    RayDifferential differential = {
+        (dpx * length_squared - direction * direction.dot(dpx)) / length_cubed,
+        (dpy * length_squared - direction * direction.dot(dpy)) / length_cubed
+    };
+
+    return CameraRay{Ray(position, direction), differential, x, y};
+}
+
+Film::Film(int width, int height, FilmEncoding encoding)
+    : width(width), height(height), encoding(encoding), pixels(static_cast<size_t>(width) * height * 3, 0) {}
+
+void Film::encode(const Vec3& color, unsigned char* rgb) const {
+    for (int c = 0; c < 3; ++c) {
+        float value = color[c];
+        if (encoding == FilmEncoding::Gamma22) {
+            value = std::pow(std::clamp(value, 0.0f, 1.0f), 1.0f / 2.2f);
+        }
+        rgb[c] = static_cast<unsigned char>(std::clamp(value * 255.0f, 0.0f, 255.0f));
+    }
+}
+
+void Film::save(const std::string& filename) const {
+    save_png(filename, pixels.data(), width, height);
+}
+
+void Integrator::radiancePacket(const CameraRay* camera_rays, int count, Vec3* out) const {
+    for (int i = 0; i < count; ++i) {
+        out[i] = radiance(camera_rays[i]);
+    }
+}
+
+Vec3 SupersampledIntegrator::radiance(const CameraRay& camera_ray) const {
+    Vec3 sum(0.0f);
+    for (int sy = 0; sy < grid; ++sy) {
+        for (int sx = 0; sx < grid; ++sx) {
+            sum += integrator.radiance(camera.generateRay(camera_ray.x, camera_ray.y, (sx + 0.5f) / grid, (sy + 0.5f) / grid));
+        }
+    }
+    return sum / float(grid * grid);
+}
+
+void renderImage(const Camera& camera, const Integrator& integrator, Film& film, TaskPool& pool, const TileOrder& order) {
+    auto render = [&](const std::vector<Tile>& tiles) {
+        renderTileRuns(pool, film.getPixels(), film.getWidth(), tiles, order.pixels, PACKET_SIZE, [&](const PixelRun& run) {
+            CameraRay rays[PACKET_SIZE];
+            for (int i = 0; i < run.count; ++i) {
+                rays[i] = camera.generateRay(run.x[i], run.y[i]);
+            }
+
+            Vec3 colors[PACKET_SIZE];
+            integrator.radiancePacket(rays, run.count, colors);
+            for (int i = 0; i < run.count; ++i) {
+                film.encode(colors[i], run.rgb[i]);
+            }
+        });
+    };
+
+    std::vector<Tile> tiles = imageTiles(film.getWidth(), film.getHeight(), order);
+    switch (tileFarmRole()) {
+        case FarmRole::Worker:
+            if (!serveTiles(film.getPixels(), film.getWidth(), film.getHeight(), tiles, render)) std::exit(0);
+            return;
+        case FarmRole::Coordinator:
+            // What the workers could not deliver is rendered here
+            tiles = farmTiles(film.getPixels(), film.getWidth(), film.getHeight(), tiles);
+            break;
+        case FarmRole::None:
+        default:
+            break;
+    }
+    render(tiles);
+}
+
+void renderImage(const Camera& camera, const Integrator& integrator, Film& film, const TileOrder& order) {
+    renderImage(camera, integrator, film, TaskPool::shared(), order);
+}
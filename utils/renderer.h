@@ -0,0 +1,117 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+/*
+ * Render core shared by the executables
+ *
+ * A Camera turns a pixel into a primary ray, an Integrator turns that ray
+ * into radiance, and a Film encodes the radiance into the RGB8 image that
+ * is written out. renderImage() drives the three over the tiles of the
+ * image on a TaskPool, so every integrator is traced the same way.
+ *
+ * With --farm, renderImage() splits the frame between worker processes
+ * instead (see tile_farm.h).
+ *
+ * Rays reach the integrator in packets of up to PACKET_SIZE consecutive
+ * pixels of a tile, in the pixel order of the TileOrder. The default
+ * radiancePacket() shades them one by one; integrators with a SIMD path
+ * override it to shade the packet across lanes.
+ */
+
+#include "vec3.h"
+#include "geometry.h"
+#include "tile_scheduler.h"
+#include <string>
+#include <vector>
+
+// Derivatives of a camera ray's direction with respect to the pixel coordinates
+struct RayDifferential {
+    Vec3 ddx;
+    Vec3 ddy;
+};
+
+struct CameraRay {
+    Ray ray;
+    RayDifferential differential;
+    int x, y;       // Pixel the ray goes through
+};
+
+// Pinhole camera looking down -z with its image plane at z = -1
+class Camera {
+public:
+    // Square pixels, centered on the view axis; `fov` is the vertical field of view in radians
+    Camera(const Vec3& position, int width, int height, float fov);
+    // Any image plane: the direction through pixel coordinates (x, y) is corner + dpx * x + dpy * y
+    Camera(const Vec3& position, const Vec3& corner, const Vec3& dpx, const Vec3& dpy);
+    // At `position` looking at `target` with +y up (or -z when looking straight up or down). This is the
+    // framing of rendering.cpp, where the vertical pixel pitch is measured against the width.
+    static Camera lookAt(const Vec3& position, const Vec3& target, int width, int height, float fov);
+
+    const Vec3& getPosition() const { return position; }
+
+    // Ray through the point (x + sx, y + sy) of the image, by default the pixel center
+    CameraRay generateRay(int x, int y, float sx = 0.5f, float sy = 0.5f) const;
+
+private:
+    Vec3 position;
+    Vec3 corner;
+    Vec3 dpx;
+    Vec3 dpy;
+};
+
+enum class FilmEncoding {
+    Linear,     // Radiance scaled to bytes and clamped
+    Gamma22     // Clamped to [0, 1], then gamma encoded with an exponent of 1/2.2
+};
+
+class Film {
+public:
+    Film(int width, int height, FilmEncoding encoding = FilmEncoding::Linear);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    unsigned char* getPixels() { return pixels.data(); }
+    const unsigned char* getPixels() const { return pixels.data(); }
+
+    void encode(const Vec3& color, unsigned char* rgb) const;
+    void save(const std::string& filename) const;
+
+private:
+    int width;
+    int height;
+    FilmEncoding encoding;
+    std::vector<unsigned char> pixels;   // RGB8, row by row from the top
+};
+
+const int PACKET_SIZE = MAX_RUN_LENGTH;     // One run of the tile driver
+
+class Integrator {
+public:
+    virtual ~Integrator() = default;
+
+    // Radiance arriving at the camera along a primary ray; called from all render threads at once
+    virtual Vec3 radiance(const CameraRay& camera_ray) const = 0;
+
+    // Radiance along `count` (at most PACKET_SIZE) camera rays of neighbouring pixels
+    virtual void radiancePacket(const CameraRay* camera_rays, int count, Vec3* out) const;
+};
+
+// Averages a grid x grid pattern of rays over each pixel; the packet path of `integrator` is not used
+class SupersampledIntegrator : public Integrator {
+public:
+    SupersampledIntegrator(const Camera& camera, const Integrator& integrator, int grid)
+        : camera(camera), integrator(integrator), grid(grid) {}
+
+    Vec3 radiance(const CameraRay& camera_ray) const override;
+
+private:
+    const Camera& camera;
+    const Integrator& integrator;
+    int grid;
+};
+
+// Shades every pixel of `film` through `integrator`, one tile per task on `pool`, visited in `order`
+void renderImage(const Camera& camera, const Integrator& integrator, Film& film, TaskPool& pool, const TileOrder& order = TileOrder());
+void renderImage(const Camera& camera, const Integrator& integrator, Film& film, const TileOrder& order = TileOrder());
+
+#endif // RENDERER_H
@@ -0,0 +1,104 @@
+#include "resident_scenes.h"
+#include "render_server.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+
+std::unique_ptr<ResidentScene> loadResidentScene(const std::string& mesh_path, const std::string& texture_path,
+                                                 const SceneLoadOptions& options, const Material& material, std::string& error) {
+    auto scene = std::make_unique<ResidentScene>();
+    Mesh& mesh = scene->mesh;
+    mesh.setMipFilter(options.mip_filter);
+    mesh.setTextureLayout(options.texture_layout);
+    mesh.setTextureCache(options.texture_cache);
+    mesh.setCacheEnabled(options.mesh_cache);
+
+    std::future<bool> texture_loaded = std::async(std::launch::async, [&]() {
+        return mesh.loadTexture(texture_path, options.texture_width, options.texture_height);
+    });
+    bool geometry_loaded = mesh.loadGeometry(mesh_path);
+    if (geometry_loaded && options.weld_vertices) mesh.weld();
+    if (!geometry_loaded || mesh.getTriangleCount(0) == 0) {
+        texture_loaded.wait();
+        error = "Failed to load " + mesh_path;
+        return nullptr;
+    }
+
+    BoundingBox mesh_bounds = mesh.getBoundingBox();
+    QuantizationFrame frame(mesh_bounds.min, mesh_bounds.max);
+    appendTriangles(mesh, 0, material, options.compact_attributes ? &frame : nullptr, scene->primitives);
+    scene->tree = std::make_unique<PrimitiveTree>(scene->primitives);
+
+    if (!texture_loaded.get()) {
+        error = "Failed to load texture " + texture_path;
+        return nullptr;
+    }
+    return scene;
+}
+
+bool serveResidentScenes(const std::string& socket_path, int max_scenes, const std::string& mesh_path, const std::string& texture_path,
+                         const SceneLoadOptions& options, const Material& material,
+                         const std::map<std::string, SceneIntegratorFactory>& integrators, float fov, const TileOrder& tile_order) {
+    // Keyed by mesh and texture path; only the render thread touches the scenes, the count is read for stats
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<ResidentScene>> scenes;
+    std::atomic<size_t> scene_count{0};
+    unsigned long long uses = 0;
+
+    auto find_scene = [&](const std::string& job_mesh, const std::string& job_texture, std::string& error) -> ResidentScene* {
+        std::pair<std::string, std::string> key(absolute_path(job_mesh.empty() ? mesh_path : job_mesh),
+                                                absolute_path(job_texture.empty() ? texture_path : job_texture));
+        auto found = scenes.find(key);
+        if (found == scenes.end()) {
+            auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<ResidentScene> scene = loadResidentScene(key.first, key.second, options, material, error);
+            if (!scene) return nullptr;
+            std::cout << "Loaded " << key.first << " (" << scene->primitives.size() << " triangles) in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+            while (!scenes.empty() && static_cast<int>(scenes.size()) >= max_scenes) {
+                auto oldest = std::min_element(scenes.begin(), scenes.end(), [](const auto& a, const auto& b) {
+                    return a.second->last_used < b.second->last_used;
+                });
+                std::cout << "Dropped " << oldest->first.first << std::endl;
+                scenes.erase(oldest);
+            }
+            found = scenes.emplace(key, std::move(scene)).first;
+            scene_count = scenes.size();
+        }
+        found->second->last_used = ++uses;
+        return found->second.get();
+    };
+
+    // The server's own mesh is loaded up front, so the first job does not wait for it
+    std::string error;
+    if (!find_scene("", "", error)) std::cerr << error << std::endl;
+
+    RenderServer server([&](const RenderJob& job, std::string& error) -> std::unique_ptr<Film> {
+        auto factory = integrators.find(job.integrator);
+        if (factory == integrators.end()) {
+            error = "Unknown integrator: " + job.integrator;
+            return nullptr;
+        }
+        ResidentScene* scene = find_scene(job.mesh_path, job.texture_path, error);
+        if (!scene) return nullptr;
+        std::unique_ptr<Integrator> integrator = factory->second(*scene);
+
+        auto film = std::make_unique<Film>(job.width, job.height, FilmEncoding::Gamma22);
+        Camera camera = Camera::lookAt(job.camera, job.target, job.width, job.height, fov);
+        int grid = std::max(1, static_cast<int>(std::sqrt(float(job.samples))));
+        if (grid > 1) {
+            renderImage(camera, SupersampledIntegrator(camera, *integrator, grid), *film, tile_order);
+        } else {
+            renderImage(camera, *integrator, *film, tile_order);
+        }
+        return film;
+    }, [&]() {
+        return "scenes=" + std::to_string(scene_count.load());
+    });
+
+    return server.serve(socket_path);
+}
@@ -0,0 +1,67 @@
+#ifndef RESIDENT_SCENES_H
+#define RESIDENT_SCENES_H
+
+/*
+ * Scenes kept loaded between the jobs of a render server
+ *
+ * serveResidentScenes() answers the jobs of a RenderServer (see
+ * render_server.h) from meshes that stay in memory with their triangles and
+ * tree, so a job for a scene that is already loaded goes straight to
+ * tracing. Scenes are keyed by their resolved mesh and texture paths, and
+ * the least recently used one is dropped once `max_scenes` are loaded.
+ *
+ * The integrator names a job may ask for are those of the factory map the
+ * caller passes in; any other name is refused before a scene is loaded.
+ */
+
+#include "mesh.h"
+#include "material.h"
+#include "primitive_tree.h"
+#include "renderer.h"
+#include "tile_scheduler.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How the meshes and textures of the scenes are loaded
+struct SceneLoadOptions {
+    int texture_width = 4096;
+    int texture_height = 4096;
+    MipFilter mip_filter = MipFilter::Trilinear;
+    TextureLayout texture_layout = TextureLayout::Linear;
+    TextureCache* texture_cache = nullptr;
+    bool compact_attributes = false;    // CompactTriangles instead of Triangles
+    bool weld_vertices = false;
+    bool mesh_cache = false;
+};
+
+// A mesh with its triangles and tree
+struct ResidentScene {
+    Mesh mesh;
+    std::vector<Primitive*> primitives;
+    std::unique_ptr<PrimitiveTree> tree;
+    unsigned long long last_used = 0;
+
+    ~ResidentScene() {
+        for (Primitive* primitive : primitives) {
+            delete primitive;
+        }
+    }
+};
+
+// Loads the geometry while the texture decodes, then builds the tree; null with a message on failure
+std::unique_ptr<ResidentScene> loadResidentScene(const std::string& mesh_path, const std::string& texture_path,
+                                                 const SceneLoadOptions& options, const Material& material, std::string& error);
+
+// Makes the integrator a job asked for, over one loaded scene
+using SceneIntegratorFactory = std::function<std::unique_ptr<Integrator>(const ResidentScene& scene)>;
+
+// Serves render jobs on `socket_path` until a stop request, keeping up to `max_scenes` scenes loaded.
+// Jobs that name no mesh or texture use `mesh_path` and `texture_path`, which are loaded up front.
+bool serveResidentScenes(const std::string& socket_path, int max_scenes, const std::string& mesh_path, const std::string& texture_path,
+                         const SceneLoadOptions& options, const Material& material,
+                         const std::map<std::string, SceneIntegratorFactory>& integrators, float fov, const TileOrder& tile_order);
+
+#endif // RESIDENT_SCENES_H
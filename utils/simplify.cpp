@@ -0,0 +1,250 @@
+#include "simplify.h"
+#include "vec3.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+    // Symmetric 4x4 matrix stored as its upper triangle
+    struct Quadric {
+        double a[10] = {};
+
+        void addPlane(double nx, double ny, double nz, double d, double weight) {
+            a[0] += weight * nx * nx; a[1] += weight * nx * ny; a[2] += weight * nx * nz; a[3] += weight * nx * d;
+            a[4] += weight * ny * ny; a[5] += weight * ny * nz; a[6] += weight * ny * d;
+            a[7] += weight * nz * nz; a[8] += weight * nz * d;
+            a[9] += weight * d * d;
+        }
+
+        void add(const Quadric& q) {
+            for (int i = 0; i < 10; ++i) a[i] += q.a[i];
+        }
+
+        double error(const Vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                 + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                 + a[7] * z * z + 2 * a[8] * z
+                 + a[9];
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from, to;
+        uint32_t from_version, to_version;
+
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    class Simplifier {
+    public:
+        Simplifier(const float* vertex_positions, size_t vertex_count, const uint32_t* indices, size_t index_count)
+            : position_of(vertex_count) {
+            // Group welded vertices that share a position
+            std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                const float* position = vertex_positions + 3 * static_cast<size_t>(v);
+                uint32_t bits[3];
+                std::memcpy(bits, position, sizeof(bits));
+                uint64_t hash = (static_cast<uint64_t>(bits[0]) * 73856093u) ^ (static_cast<uint64_t>(bits[1]) * 19349663u) ^ (static_cast<uint64_t>(bits[2]) * 83492791u);
+
+                std::vector<uint32_t>& bucket = buckets[hash];
+                uint32_t id = static_cast<uint32_t>(-1);
+                for (uint32_t candidate : bucket) {
+                    if (std::memcmp(&positions[candidate], position, sizeof(float) * 3) == 0) id = candidate;
+                }
+                if (id == static_cast<uint32_t>(-1)) {
+                    id = static_cast<uint32_t>(positions.size());
+                    positions.emplace_back(position[0], position[1], position[2]);
+                    bucket.push_back(id);
+                }
+                position_of[v] = id;
+            }
+
+            size_t position_count = positions.size();
+            quadrics.resize(position_count);
+            position_triangles.resize(position_count);
+            locked.assign(position_count, false);
+            removed.assign(position_count, false);
+            version.assign(position_count, 0);
+
+            size_t triangle_count = index_count / 3;
+            triangles.resize(triangle_count);
+            alive.assign(triangle_count, true);
+            live_triangles = triangle_count;
+
+            std::unordered_map<uint64_t, int> edge_use;
+            edge_use.reserve(index_count);
+
+            for (size_t t = 0; t < triangle_count; ++t) {
+                std::array<uint32_t, 3>& tri = triangles[t];
+                tri = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+                for (uint32_t& index : tri) {
+                    if (index >= vertex_count) index = 0;  // As Mesh::weldedVertex() reads a damaged cache
+                }
+                uint32_t p[3] = {position_of[tri[0]], position_of[tri[1]], position_of[tri[2]]};
+
+                Vec3 normal = (positions[p[1]] - positions[p[0]]).cross(positions[p[2]] - positions[p[0]]);
+                double area = normal.length();
+                if (area > 0.0) {
+                    Vec3 n = normal / static_cast<float>(area);
+                    double d = -n.dot(positions[p[0]]);
+                    for (uint32_t id : p) quadrics[id].addPlane(n.x, n.y, n.z, d, area * 0.5);
+                }
+
+                for (int k = 0; k < 3; ++k) {
+                    position_triangles[p[k]].push_back(static_cast<uint32_t>(t));
+                    edge_use[edgeKey(p[k], p[(k + 1) % 3])]++;
+                }
+            }
+
+            // Open edges of the surface (not seams, which are shared by two triangles by position)
+            for (const auto& [key, uses] : edge_use) {
+                if (uses == 1) {
+                    locked[key >> 32] = true;
+                    locked[key & 0xffffffffu] = true;
+                }
+            }
+
+            for (size_t t = 0; t < triangle_count; ++t) {
+                for (int k = 0; k < 3; ++k) {
+                    pushEdge(position_of[triangles[t][k]], position_of[triangles[t][(k + 1) % 3]]);
+                }
+            }
+        }
+
+        std::vector<uint32_t> run(size_t target_triangles) {
+            while (live_triangles > target_triangles && !queue.empty()) {
+                Collapse collapse = queue.top();
+                queue.pop();
+
+                if (removed[collapse.from] || removed[collapse.to]) continue;
+                if (version[collapse.from] != collapse.from_version || version[collapse.to] != collapse.to_version) continue;
+
+                apply(collapse.from, collapse.to);
+            }
+
+            std::vector<uint32_t> result;
+            result.reserve(live_triangles * 3);
+            for (size_t t = 0; t < triangles.size(); ++t) {
+                if (alive[t]) result.insert(result.end(), triangles[t].begin(), triangles[t].end());
+            }
+            return result;
+        }
+
+    private:
+        std::vector<uint32_t> position_of;                 // Welded vertex -> position id
+        std::vector<Vec3> positions;
+        std::vector<Quadric> quadrics;
+        std::vector<std::vector<uint32_t>> position_triangles;
+        std::vector<std::array<uint32_t, 3>> triangles;    // Welded vertex indices
+        std::vector<bool> alive;
+        std::vector<bool> locked;
+        std::vector<bool> removed;
+        std::vector<uint32_t> version;
+        size_t live_triangles = 0;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+        static uint64_t edgeKey(uint32_t a, uint32_t b) {
+            if (a > b) std::swap(a, b);
+            return (static_cast<uint64_t>(a) << 32) | b;
+        }
+
+        bool touches(const std::array<uint32_t, 3>& tri, uint32_t position) const {
+            return position_of[tri[0]] == position || position_of[tri[1]] == position || position_of[tri[2]] == position;
+        }
+
+        void pushEdge(uint32_t a, uint32_t b) {
+            if (a == b) return;
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            if (!locked[a]) queue.push({q.error(positions[b]), a, b, version[a], version[b]});
+            if (!locked[b]) queue.push({q.error(positions[a]), b, a, version[b], version[a]});
+        }
+
+        // Pairs every copy of `from` with the single copy of `to` it shares a triangle with
+        bool matchCopies(uint32_t from, uint32_t to, std::unordered_map<uint32_t, uint32_t>& remap) const {
+            for (uint32_t t : position_triangles[from]) {
+                if (!alive[t] || !touches(triangles[t], to)) continue;
+                uint32_t source = 0, target = 0;
+                for (uint32_t v : triangles[t]) {
+                    if (position_of[v] == from) source = v;
+                    if (position_of[v] == to) target = v;
+                }
+                auto inserted = remap.emplace(source, target);
+                if (!inserted.second && inserted.first->second != target) return false;
+            }
+
+            for (uint32_t t : position_triangles[from]) {
+                if (!alive[t]) continue;
+                for (uint32_t v : triangles[t]) {
+                    if (position_of[v] == from && remap.find(v) == remap.end()) return false;
+                }
+            }
+            return true;
+        }
+
+        // Rejects collapses that would flip a surviving triangle
+        bool flips(uint32_t from, uint32_t to) const {
+            for (uint32_t t : position_triangles[from]) {
+                if (!alive[t] || touches(triangles[t], to)) continue;
+
+                Vec3 p[3], q[3];
+                for (int k = 0; k < 3; ++k) {
+                    uint32_t id = position_of[triangles[t][k]];
+                    p[k] = positions[id];
+                    q[k] = id == from ? positions[to] : p[k];
+                }
+                Vec3 before = (p[1] - p[0]).cross(p[2] - p[0]);
+                Vec3 after = (q[1] - q[0]).cross(q[2] - q[0]);
+                if (before.dot(after) <= 0.0f) return true;
+            }
+            return false;
+        }
+
+        void apply(uint32_t from, uint32_t to) {
+            std::unordered_map<uint32_t, uint32_t> remap;
+            if (!matchCopies(from, to, remap) || flips(from, to)) return;
+
+            for (uint32_t t : position_triangles[from]) {
+                if (!alive[t]) continue;
+                std::array<uint32_t, 3>& tri = triangles[t];
+                if (touches(tri, to)) {
+                    alive[t] = false;
+                    --live_triangles;
+                    continue;
+                }
+                for (uint32_t& v : tri) {
+                    if (position_of[v] == from) v = remap[v];
+                }
+                position_triangles[to].push_back(t);
+            }
+
+            removed[from] = true;
+            position_triangles[from].clear();
+            quadrics[to].add(quadrics[from]);
+            ++version[to];
+
+            // Compact the triangle list of the survivor and requeue its edges
+            std::vector<uint32_t>& around = position_triangles[to];
+            around.erase(std::remove_if(around.begin(), around.end(), [this](uint32_t t) { return !alive[t]; }), around.end());
+            std::sort(around.begin(), around.end());
+            around.erase(std::unique(around.begin(), around.end()), around.end());
+            for (uint32_t t : around) {
+                for (uint32_t v : triangles[t]) {
+                    pushEdge(to, position_of[v]);
+                }
+            }
+        }
+    };
+}
+
+std::vector<uint32_t> simplifyMesh(const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count, size_t target_triangles) {
+    if (index_count / 3 <= target_triangles) return std::vector<uint32_t>(indices, indices + index_count);
+    Simplifier simplifier(positions, vertex_count, indices, index_count);
+    return simplifier.run(target_triangles);
+}
@@ -0,0 +1,21 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Quadric error metric simplification (Garland & Heckbert, "Surface
+ * Simplification Using Quadric Error Metrics", 1997) restricted to
+ * half-edge collapses, so the result indexes into the same vertex buffer
+ * as its input and every level of detail can share one set of vertices.
+ *
+ * Collapses work on positions: every welded copy of a position (UV or
+ * normal seams) moves together, and a collapse is only taken when each copy
+ * has exactly one matching copy at the target, so seams never open.
+ * Vertices on open edges of the surface are never removed.
+ */
+std::vector<uint32_t> simplifyMesh(const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count, size_t target_triangles);
+
+#endif // SIMPLIFY_H
@@ -0,0 +1,338 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "texture.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const size_t TEXEL_ALIGNMENT = 64;
+    const int ENCODE_STEPS = 4096;
+
+    struct DecodeTables {
+        float srgb[256];
+        float linear[256];
+        uint8_t srgb_encode[ENCODE_STEPS + 1];   // Linear value quantized to ENCODE_STEPS -> sRGB byte
+
+        DecodeTables() {
+            for (int i = 0; i < 256; ++i) {
+                float c = i / 255.0f;
+                srgb[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                linear[i] = c;
+            }
+            for (int i = 0; i <= ENCODE_STEPS; ++i) {
+                float l = static_cast<float>(i) / ENCODE_STEPS;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                srgb_encode[i] = static_cast<uint8_t>(std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f));
+            }
+        }
+    };
+
+    const DecodeTables& decodeTables() {
+        static const DecodeTables tables;
+        return tables;
+    }
+
+    inline texel_lanes broadcast(float value) {
+        return texel_lanes{value, value, value, value};
+    }
+
+    // Spreads the low 16 bits of `v` to the even bit positions
+    inline uint32_t partBy1(uint32_t v) {
+        v &= 0x0000ffffu;
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+
+    inline int ceilLog2(int value) {
+        int shift = 0;
+        while ((1 << shift) < value) ++shift;
+        return shift;
+    }
+
+    size_t alignTexels(size_t count) {
+        const size_t texels_per_line = TEXEL_ALIGNMENT / 4;
+        return (count + texels_per_line - 1) / texels_per_line * texels_per_line;
+    }
+}
+
+const float* textureDecodeTable(bool srgb) {
+    return srgb ? decodeTables().srgb : decodeTables().linear;
+}
+
+float textureLevelOfDetail(int width, int height, const Vec3& duvdx, const Vec3& duvdy) {
+    float fx = std::hypot(duvdx.x * width, duvdx.y * height);
+    float fy = std::hypot(duvdy.x * width, duvdy.y * height);
+    float footprint = std::max(fx, fy);
+    return footprint > 1.0f ? std::log2(footprint) : 0.0f;
+}
+
+bool Texture::load(const std::string& filename, bool srgb, TextureLayout layout) {
+    int texWidth, texHeight, channels;
+    unsigned char* data = stbi_load(filename.c_str(), &texWidth, &texHeight, &channels, 4);
+    if (!data) {
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+        return false;
+    }
+
+    // Every level starts on an aligned boundary of one allocation
+    levels.clear();
+    size_t texel_count = 0;
+    for (int w = texWidth, h = texHeight;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        levels.push_back({w, h, texel_count, 0, 0, 0});
+        texel_count += alignTexels(static_cast<size_t>(w) * h);
+        if (w == 1 && h == 1) break;
+    }
+
+    texels.reset(static_cast<uint8_t*>(std::aligned_alloc(TEXEL_ALIGNMENT, texel_count * 4)));
+    if (!texels) {
+        std::cerr << "Not enough memory for texture: " << filename << std::endl;
+        stbi_image_free(data);
+        levels.clear();
+        return false;
+    }
+    std::memcpy(texels.get(), data, static_cast<size_t>(texWidth) * texHeight * 4);
+    stbi_image_free(data);
+
+    this->srgb = srgb;
+    decode = textureDecodeTable(srgb);
+    this->layout = TextureLayout::Linear;
+    buildMipLevels();
+
+    if (layout != TextureLayout::Linear) {
+        this->layout = layout;
+        if (!swizzle()) {
+            this->layout = TextureLayout::Linear;
+            std::cerr << "Not enough memory for texture: " << filename << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Moves every level from scanline order into the layout's order, in a new allocation;
+// false, leaving the texels in scanline order, when that cannot be allocated
+bool Texture::swizzle() {
+    std::vector<Level> swizzled = levels;
+    size_t texel_count = 0;
+    for (Level& level : swizzled) {
+        size_t padded;
+        if (layout == TextureLayout::Morton) {
+            int side_shift = std::min(ceilLog2(level.width), ceilLog2(level.height));
+            level.block_shift = side_shift;
+            level.row_blocks = ((1 << ceilLog2(level.width)) >> side_shift);
+            padded = (static_cast<size_t>(1) << ceilLog2(level.width)) << ceilLog2(level.height);
+        } else {
+            int tile = layout == TextureLayout::Tiled4 ? 4 : 8;
+            level.row_tiles = (level.width + tile - 1) / tile;
+            padded = static_cast<size_t>(level.row_tiles) * ((level.height + tile - 1) / tile) * tile * tile;
+        }
+        level.offset = texel_count;
+        texel_count += alignTexels(padded);
+    }
+
+    std::unique_ptr<uint8_t[], AlignedFree> target(static_cast<uint8_t*>(std::aligned_alloc(TEXEL_ALIGNMENT, texel_count * 4)));
+    if (!target) return false;
+    std::memset(target.get(), 0, texel_count * 4);
+
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const Level& source = levels[l];
+        const Level& level = swizzled[l];
+        for (int y = 0; y < source.height; ++y) {
+            for (int x = 0; x < source.width; ++x) {
+                size_t index = 0;
+                switch (layout) {
+                    case TextureLayout::Tiled4: index = texelIndex<TextureLayout::Tiled4>(level, x, y); break;
+                    case TextureLayout::Tiled8: index = texelIndex<TextureLayout::Tiled8>(level, x, y); break;
+                    case TextureLayout::Morton: index = texelIndex<TextureLayout::Morton>(level, x, y); break;
+                    case TextureLayout::Linear: index = texelIndex<TextureLayout::Linear>(level, x, y); break;
+                }
+                std::memcpy(&target[index * 4], &texels[(source.offset + static_cast<size_t>(y) * source.width + x) * 4], 4);
+            }
+        }
+    }
+
+    texels = std::move(target);
+    levels = std::move(swizzled);
+    return true;
+}
+
+template <TextureLayout L>
+inline size_t Texture::texelIndex(const Level& level, int x, int y) const {
+    if constexpr (L == TextureLayout::Tiled4 || L == TextureLayout::Tiled8) {
+        constexpr int shift = L == TextureLayout::Tiled4 ? 2 : 3;
+        constexpr int mask = (1 << shift) - 1;
+        size_t tile = static_cast<size_t>(y >> shift) * level.row_tiles + (x >> shift);
+        return level.offset + (tile << (2 * shift)) + ((y & mask) << shift) + (x & mask);
+    } else if constexpr (L == TextureLayout::Morton) {
+        int mask = (1 << level.block_shift) - 1;
+        size_t block = static_cast<size_t>(y >> level.block_shift) * level.row_blocks + (x >> level.block_shift);
+        return level.offset + (block << (2 * level.block_shift)) + (partBy1(x & mask) | (partBy1(y & mask) << 1));
+    } else {
+        return level.offset + static_cast<size_t>(y) * level.width + x;
+    }
+}
+
+// 2x2 box filter in linear space, clamped at odd edges
+void Texture::buildMipLevels() {
+    const DecodeTables& tables = decodeTables();
+    for (size_t l = 1; l < levels.size(); ++l) {
+        const Level& source = levels[l - 1];
+        const Level& target = levels[l];
+        const uint8_t* src = &texels[source.offset * 4];
+        uint8_t* dst = &texels[target.offset * 4];
+
+        for (int y = 0; y < target.height; ++y) {
+            int y0 = std::min(2 * y, source.height - 1);
+            int y1 = std::min(2 * y + 1, source.height - 1);
+            for (int x = 0; x < target.width; ++x) {
+                int x0 = std::min(2 * x, source.width - 1);
+                int x1 = std::min(2 * x + 1, source.width - 1);
+                const uint8_t* corners[4] = {
+                    &src[(static_cast<size_t>(y0) * source.width + x0) * 4], &src[(static_cast<size_t>(y0) * source.width + x1) * 4],
+                    &src[(static_cast<size_t>(y1) * source.width + x0) * 4], &src[(static_cast<size_t>(y1) * source.width + x1) * 4]
+                };
+
+                uint8_t* texel = &dst[(static_cast<size_t>(y) * target.width + x) * 4];
+                for (int c = 0; c < 4; ++c) {
+                    if (srgb && c < 3) {
+                        float sum = 0.0f;
+                        for (const uint8_t* corner : corners) sum += decode[corner[c]];
+                        texel[c] = tables.srgb_encode[std::lround(sum * 0.25f * ENCODE_STEPS)];
+                    } else {
+                        int sum = corners[0][c] + corners[1][c] + corners[2][c] + corners[3][c];
+                        texel[c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+}
+
+float Texture::getLevelOfDetail(const Vec3& duvdx, const Vec3& duvdy) const {
+    if (levels.empty()) return 0.0f;
+    return textureLevelOfDetail(levels[0].width, levels[0].height, duvdx, duvdy);
+}
+
+template <TextureLayout L>
+inline texel_lanes Texture::fetch(const Level& level, int x, int y) const {
+    const uint8_t* texel = &texels[texelIndex<L>(level, x, y) * 4];
+    return texel_lanes{decode[texel[0]], decode[texel[1]], decode[texel[2]], 0.0f};
+}
+
+texel_lanes Texture::bilinear(const Level& level, float u, float v) const {
+    switch (layout) {
+        case TextureLayout::Tiled4: return bilinear<TextureLayout::Tiled4>(level, u, v);
+        case TextureLayout::Tiled8: return bilinear<TextureLayout::Tiled8>(level, u, v);
+        case TextureLayout::Morton: return bilinear<TextureLayout::Morton>(level, u, v);
+        case TextureLayout::Linear:
+        default: return bilinear<TextureLayout::Linear>(level, u, v);
+    }
+}
+
+template <TextureLayout L>
+texel_lanes Texture::bilinear(const Level& level, float u, float v) const {
+    float x = std::clamp(u, 0.0f, 1.0f) * (level.width - 1);
+    float y = (1.0f - std::clamp(v, 0.0f, 1.0f)) * (level.height - 1);
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, level.width - 1);
+    int y1 = std::min(y0 + 1, level.height - 1);
+
+    texel_lanes c00 = fetch<L>(level, x0, y0);
+    texel_lanes c10 = fetch<L>(level, x1, y0);
+    texel_lanes c01 = fetch<L>(level, x0, y1);
+    texel_lanes c11 = fetch<L>(level, x1, y1);
+
+    texel_lanes wx = broadcast(x - x0);
+    texel_lanes top = c00 + (c10 - c00) * wx;
+    texel_lanes bottom = c01 + (c11 - c01) * wx;
+    return top + (bottom - top) * broadcast(y - y0);
+}
+
+texel_lanes Texture::filter(float u, float v, float lod) const {
+    float max_level = static_cast<float>(levels.size() - 1);
+    lod = std::clamp(lod, 0.0f, max_level);
+
+    switch (mip_filter) {
+        case MipFilter::None:
+            return bilinear(levels[0], u, v);
+        case MipFilter::Nearest:
+            return bilinear(levels[static_cast<size_t>(lod + 0.5f)], u, v);
+        case MipFilter::Trilinear:
+        default: {
+            size_t l0 = static_cast<size_t>(lod);
+            float f = lod - l0;
+            texel_lanes fine = bilinear(levels[l0], u, v);
+            if (f <= 0.0f) return fine;
+            texel_lanes coarse = bilinear(levels[l0 + 1], u, v);
+            return fine + (coarse - fine) * broadcast(f);
+        }
+    }
+}
+
+template <int N>
+void Texture::sampleBatch(const float* u, const float* v, Vec3* out, const float* lod) const {
+    if (lod && mip_filter != MipFilter::None) {
+        for (int i = 0; i < N; ++i) {
+            texel_lanes color = filter(u[i], v[i], lod[i]);
+            out[i] = Vec3(color[0], color[1], color[2]);
+        }
+        return;
+    }
+
+    switch (layout) {
+        case TextureLayout::Tiled4: sampleLevel<TextureLayout::Tiled4, N>(levels[0], u, v, out); break;
+        case TextureLayout::Tiled8: sampleLevel<TextureLayout::Tiled8, N>(levels[0], u, v, out); break;
+        case TextureLayout::Morton: sampleLevel<TextureLayout::Morton, N>(levels[0], u, v, out); break;
+        case TextureLayout::Linear: sampleLevel<TextureLayout::Linear, N>(levels[0], u, v, out); break;
+    }
+}
+
+template <TextureLayout L, int N>
+void Texture::sampleLevel(const Level& level, const float* u, const float* v, Vec3* out) const {
+    // Coordinates for every lane first, in a loop the compiler can vectorize
+    float x[N], y[N];
+    int x0[N], y0[N];
+    for (int i = 0; i < N; ++i) {
+        x[i] = std::clamp(u[i], 0.0f, 1.0f) * (level.width - 1);
+        y[i] = (1.0f - std::clamp(v[i], 0.0f, 1.0f)) * (level.height - 1);
+        x0[i] = static_cast<int>(x[i]);
+        y0[i] = static_cast<int>(y[i]);
+        x[i] -= x0[i];
+        y[i] -= y0[i];
+    }
+
+    for (int i = 0; i < N; ++i) {
+        int x1 = std::min(x0[i] + 1, level.width - 1);
+        int y1 = std::min(y0[i] + 1, level.height - 1);
+
+        texel_lanes c00 = fetch<L>(level, x0[i], y0[i]);
+        texel_lanes c10 = fetch<L>(level, x1, y0[i]);
+        texel_lanes c01 = fetch<L>(level, x0[i], y1);
+        texel_lanes c11 = fetch<L>(level, x1, y1);
+
+        texel_lanes wx = broadcast(x[i]);
+        texel_lanes top = c00 + (c10 - c00) * wx;
+        texel_lanes bottom = c01 + (c11 - c01) * wx;
+        texel_lanes color = top + (bottom - top) * broadcast(y[i]);
+        out[i] = Vec3(color[0], color[1], color[2]);
+    }
+}
+
+Vec3 Texture::sample(float u, float v, float lod) const {
+    texel_lanes color = filter(u, v, lod);
+    return Vec3(color[0], color[1], color[2]);
+}
+
+void Texture::sample4(const float u[4], const float v[4], Vec3 out[4], const float* lod) const {
+    sampleBatch<4>(u, v, out, lod);
+}
+
+void Texture::sample8(const float u[8], const float v[8], Vec3 out[8], const float* lod) const {
+    sampleBatch<8>(u, v, out, lod);
+}
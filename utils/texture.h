@@ -0,0 +1,119 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+/*
+ * 2D texture
+ *
+ * Texels live in one contiguous, 64-byte aligned RGBA8 buffer holding the
+ * whole mip pyramid, each level starting on its own 64-byte boundary.
+ * Levels are box-filtered from the one above in linear space. Samples are
+ * bilinear within a level: the four texels of a footprint are decoded
+ * through a 256-entry table (sRGB or linear) and blended on all channels at
+ * once as one 4-lane vector. The batch variants take 4 or 8 UVs per call so
+ * shading code can amortize the coordinate math over several hits.
+ *
+ * The level of detail is log2 of the footprint in base-level texels, from
+ * getLevelOfDetail(); MipFilter picks how it is used.
+ *
+ * TextureLayout only changes where a texel lives inside its level, so the
+ * four texels of a bilinear footprint share cache lines more often than in
+ * scanline order. Tiled layouts pad each level to whole tiles; Morton pads
+ * it to powers of two and stores it as square Z-order blocks.
+ */
+
+#include "vec3.h"
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef float texel_lanes __attribute__((vector_size(16)));
+
+enum class TextureLayout {
+    Linear,     // Scanlines
+    Tiled4,     // 4x4 texel tiles (one 64-byte line each), tiles in scanline order
+    Tiled8,     // 8x8 texel tiles, tiles in scanline order
+    Morton      // Z-order curve
+};
+
+enum class MipFilter {
+    None,       // Always the base level
+    Nearest,    // Bilinear in the closest level
+    Trilinear   // Bilinear in the two closest levels, blended
+};
+
+// Byte -> channel value, decoding sRGB to linear or as a plain unorm
+const float* textureDecodeTable(bool srgb);
+
+// log2 of the footprint, in texels of a width x height base level, of the UV derivatives along the two screen axes
+float textureLevelOfDetail(int width, int height, const Vec3& duvdx, const Vec3& duvdy);
+
+class Texture {
+public:
+    // `srgb` decodes the color channels from sRGB to linear, otherwise texels are plain unorms
+    bool load(const std::string& filename, bool srgb, TextureLayout layout = TextureLayout::Linear);
+
+    bool isLoaded() const { return texels != nullptr; }
+    int getWidth() const { return levels.empty() ? 0 : levels[0].width; }
+    int getHeight() const { return levels.empty() ? 0 : levels[0].height; }
+    int getLevelCount() const { return static_cast<int>(levels.size()); }
+    TextureLayout getLayout() const { return layout; }
+    bool isSrgb() const { return srgb; }
+
+    // Raw RGBA8 texels of a level; rows are contiguous only in the linear layout
+    int getLevelWidth(int level) const { return levels[level].width; }
+    int getLevelHeight(int level) const { return levels[level].height; }
+    const uint8_t* getLevelTexels(int level) const { return &texels[levels[level].offset * 4]; }
+
+    void setMipFilter(MipFilter filter) { mip_filter = filter; }
+    MipFilter getMipFilter() const { return mip_filter; }
+
+    // Level of detail for a footprint given by the UV derivatives along the two screen axes
+    float getLevelOfDetail(const Vec3& duvdx, const Vec3& duvdy) const;
+
+    // v = 0 is the bottom row of the image; coordinates are clamped to the edge
+    Vec3 sample(float u, float v, float lod = 0.0f) const;
+    void sample4(const float u[4], const float v[4], Vec3 out[4], const float* lod = nullptr) const;
+    void sample8(const float u[8], const float v[8], Vec3 out[8], const float* lod = nullptr) const;
+
+private:
+    struct AlignedFree {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+
+    struct Level {
+        int width;
+        int height;
+        size_t offset;      // First texel of the level in `texels`
+        int row_tiles;      // Tiles per row of tiles (tiled layouts)
+        int block_shift;    // log2 of the side of a square Morton block
+        int row_blocks;     // Morton blocks per row of blocks
+    };
+
+    std::unique_ptr<uint8_t[], AlignedFree> texels;
+    std::vector<Level> levels;
+    bool srgb = false;
+    const float* decode = nullptr;   // Byte -> channel value
+    MipFilter mip_filter = MipFilter::Trilinear;
+    TextureLayout layout = TextureLayout::Linear;
+
+    void buildMipLevels();
+    bool swizzle();
+
+    template <TextureLayout L>
+    size_t texelIndex(const Level& level, int x, int y) const;
+    template <TextureLayout L>
+    texel_lanes fetch(const Level& level, int x, int y) const;
+    template <TextureLayout L>
+    texel_lanes bilinear(const Level& level, float u, float v) const;
+    texel_lanes bilinear(const Level& level, float u, float v) const;
+    texel_lanes filter(float u, float v, float lod) const;
+
+    template <int N>
+    void sampleBatch(const float* u, const float* v, Vec3* out, const float* lod) const;
+    template <TextureLayout L, int N>
+    void sampleLevel(const Level& level, const float* u, const float* v, Vec3* out) const;
+};
+
+#endif // TEXTURE_H
@@ -0,0 +1,365 @@
+#include "texture_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char CACHE_MAGIC[8] = {'R', 'T', 'T', 'E', 'X', '\0', '\0', '\0'};
+    const uint32_t CACHE_VERSION = 1;
+    const uint64_t DATA_ALIGNMENT = 4096;
+    const std::string CACHE_EXTENSION = ".rttex";
+    const uint64_t EMPTY_KEY = ~0ull;
+    const int TILE_BITS = 40;               // Low bits of a slot key hold the tile index
+    const size_t MIN_SLOTS = 64;
+
+    // Followed by one LevelRecord per level, then the tiles from `data_offset` on
+    struct TextureCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t tile_size;
+        uint32_t srgb;
+        uint32_t level_count;
+        uint64_t source_size;       // Size and modification time of the image the file was made from
+        int64_t source_mtime_ns;
+        uint64_t tile_count;
+        uint64_t data_offset;
+    };
+
+    struct LevelRecord {
+        uint32_t width;
+        uint32_t height;
+        uint64_t first_tile;
+    };
+
+    bool source_stamp(const std::string& path, uint64_t& size, int64_t& mtime_ns) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        size = static_cast<uint64_t>(st.st_size);
+        mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return true;
+    }
+
+    inline texel_lanes broadcast(float value) {
+        return texel_lanes{value, value, value, value};
+    }
+
+    // Fixed per thread, so a thread keeps bumping the same counter
+    size_t counterStripe(size_t stripes) {
+        thread_local size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return hash % stripes;
+    }
+
+    bool readHeader(int fd, TextureCacheHeader& header, std::vector<LevelRecord>& records) {
+        if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) return false;
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION
+            || header.tile_size != TextureCache::TILE_SIZE || header.level_count == 0 || header.level_count > 32) {
+            return false;
+        }
+        records.resize(header.level_count);
+        ssize_t bytes = static_cast<ssize_t>(records.size() * sizeof(LevelRecord));
+        return pread(fd, records.data(), bytes, sizeof(header)) == bytes;
+    }
+}
+
+CachedTexture::~CachedTexture() {
+    if (fd >= 0) close(fd);
+}
+
+float CachedTexture::getLevelOfDetail(const Vec3& duvdx, const Vec3& duvdy) const {
+    return textureLevelOfDetail(levels[0].width, levels[0].height, duvdx, duvdy);
+}
+
+texel_lanes CachedTexture::bilinear(const Level& level, float u, float v) const {
+    float x = std::clamp(u, 0.0f, 1.0f) * (level.width - 1);
+    float y = (1.0f - std::clamp(v, 0.0f, 1.0f)) * (level.height - 1);
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int xs[4] = {x0, std::min(x0 + 1, level.width - 1), x0, 0};
+    int ys[4] = {y0, y0, std::min(y0 + 1, level.height - 1), 0};
+    xs[3] = xs[1];
+    ys[3] = ys[2];
+
+    auto tile_of = [&](int tx, int ty) {
+        return level.first_tile + static_cast<size_t>(ty / TextureCache::TILE_SIZE) * level.tiles_x + tx / TextureCache::TILE_SIZE;
+    };
+    auto texel_in = [&](const uint8_t* tile, int tx, int ty) {
+        const uint8_t* texel = tile + ((ty % TextureCache::TILE_SIZE) * TextureCache::TILE_SIZE + tx % TextureCache::TILE_SIZE) * 4;
+        return texel_lanes{decode[texel[0]], decode[texel[1]], decode[texel[2]], 0.0f};
+    };
+
+    // The whole footprint usually lies in one tile, which is then pinned once
+    texel_lanes c[4];
+    size_t first = tile_of(xs[0], ys[0]);
+    if (first == tile_of(xs[3], ys[3])) {
+        int32_t slot;
+        const uint8_t* tile = cache->acquire(*this, first, slot);
+        for (int i = 0; i < 4; ++i) c[i] = texel_in(tile, xs[i], ys[i]);
+        cache->release(slot);
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            int32_t slot;
+            const uint8_t* tile = cache->acquire(*this, tile_of(xs[i], ys[i]), slot);
+            c[i] = texel_in(tile, xs[i], ys[i]);
+            cache->release(slot);
+        }
+    }
+
+    texel_lanes wx = broadcast(x - x0);
+    texel_lanes top = c[0] + (c[1] - c[0]) * wx;
+    texel_lanes bottom = c[2] + (c[3] - c[2]) * wx;
+    return top + (bottom - top) * broadcast(y - y0);
+}
+
+texel_lanes CachedTexture::filter(float u, float v, float lod) const {
+    float max_level = static_cast<float>(levels.size() - 1);
+    lod = std::clamp(lod, 0.0f, max_level);
+
+    switch (mip_filter) {
+        case MipFilter::None:
+            return bilinear(levels[0], u, v);
+        case MipFilter::Nearest:
+            return bilinear(levels[static_cast<size_t>(lod + 0.5f)], u, v);
+        case MipFilter::Trilinear:
+        default: {
+            size_t l0 = static_cast<size_t>(lod);
+            float f = lod - l0;
+            texel_lanes fine = bilinear(levels[l0], u, v);
+            if (f <= 0.0f) return fine;
+            texel_lanes coarse = bilinear(levels[l0 + 1], u, v);
+            return fine + (coarse - fine) * broadcast(f);
+        }
+    }
+}
+
+Vec3 CachedTexture::sample(float u, float v, float lod) const {
+    texel_lanes color = filter(u, v, lod);
+    return Vec3(color[0], color[1], color[2]);
+}
+
+TextureCache::TextureCache(size_t budget_bytes)
+    : slot_count(std::max(MIN_SLOTS, budget_bytes / TILE_BYTES)),
+      slots(new Slot[slot_count]),
+      tile_memory(static_cast<uint8_t*>(std::aligned_alloc(64, slot_count * TILE_BYTES)), std::free) {
+    // Fails like the slot array above would
+    if (!tile_memory) throw std::bad_alloc();
+    for (size_t i = 0; i < slot_count; ++i) {
+        slots[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        slots[i].pins.store(0, std::memory_order_relaxed);
+        slots[i].referenced.store(false, std::memory_order_relaxed);
+        slots[i].loading.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool TextureCache::convert(const std::string& imagePath, const std::string& cachePath, bool srgb) {
+    Texture texture;
+    if (!texture.load(imagePath, srgb)) return false;
+
+    TextureCacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.tile_size = TILE_SIZE;
+    header.srgb = srgb ? 1 : 0;
+    header.level_count = static_cast<uint32_t>(texture.getLevelCount());
+    if (!source_stamp(imagePath, header.source_size, header.source_mtime_ns)) {
+        header.source_size = 0;
+        header.source_mtime_ns = 0;
+    }
+
+    std::vector<LevelRecord> records(header.level_count);
+    for (int l = 0; l < texture.getLevelCount(); ++l) {
+        LevelRecord& record = records[l];
+        record.width = static_cast<uint32_t>(texture.getLevelWidth(l));
+        record.height = static_cast<uint32_t>(texture.getLevelHeight(l));
+        record.first_tile = header.tile_count;
+        header.tile_count += static_cast<uint64_t>((record.width + TILE_SIZE - 1) / TILE_SIZE) * ((record.height + TILE_SIZE - 1) / TILE_SIZE);
+    }
+    uint64_t table_end = sizeof(header) + records.size() * sizeof(LevelRecord);
+    header.data_offset = (table_end + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+
+    // Written next to the target and renamed into place, so readers never open a partial file
+    std::string temporary = cachePath + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not write texture cache: " << cachePath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(LevelRecord)));
+    std::vector<char> padding(header.data_offset - table_end, 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+    // Tiles past the right and bottom edges are zero padded, lookups never address those texels
+    std::vector<uint8_t> tile(TILE_BYTES);
+    for (int l = 0; l < texture.getLevelCount(); ++l) {
+        int width = texture.getLevelWidth(l);
+        int height = texture.getLevelHeight(l);
+        const uint8_t* texels = texture.getLevelTexels(l);
+        for (int ty = 0; ty < height; ty += TILE_SIZE) {
+            for (int tx = 0; tx < width; tx += TILE_SIZE) {
+                std::fill(tile.begin(), tile.end(), 0);
+                int columns = std::min(TILE_SIZE, width - tx);
+                for (int y = 0; y < std::min(TILE_SIZE, height - ty); ++y) {
+                    std::memcpy(&tile[y * TILE_SIZE * 4], &texels[(static_cast<size_t>(ty + y) * width + tx) * 4], columns * 4);
+                }
+                file.write(reinterpret_cast<const char*>(tile.data()), TILE_BYTES);
+            }
+        }
+    }
+    file.close();
+
+    if (!file || std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+        std::cerr << "Could not write texture cache: " << cachePath << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+CachedTexture* TextureCache::open(const std::string& imagePath, bool srgb) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& texture : textures) {
+        if (texture->path == imagePath) return texture.get();
+    }
+
+    std::string cachePath = imagePath + CACHE_EXTENSION;
+    TextureCacheHeader header;
+    std::vector<LevelRecord> records;
+    int fd = ::open(cachePath.c_str(), O_RDONLY);
+
+    bool valid = fd >= 0 && readHeader(fd, header, records) && header.srgb == (srgb ? 1u : 0u);
+    if (valid) {
+        uint64_t source_size;
+        int64_t source_mtime_ns;
+        valid = !source_stamp(imagePath, source_size, source_mtime_ns)
+             || (source_size == header.source_size && source_mtime_ns == header.source_mtime_ns);
+        if (!valid) std::cout << "Texture cache " << cachePath << " is stale, converting " << imagePath << std::endl;
+    }
+    if (!valid) {
+        if (fd >= 0) close(fd);
+        if (!convert(imagePath, cachePath, srgb)) return nullptr;
+        std::cout << "Converted " << imagePath << " to " << cachePath << std::endl;
+        fd = ::open(cachePath.c_str(), O_RDONLY);
+        if (fd < 0 || !readHeader(fd, header, records)) {
+            if (fd >= 0) close(fd);
+            std::cerr << "Could not read texture cache: " << cachePath << std::endl;
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<CachedTexture> texture(new CachedTexture());
+    texture->cache = this;
+    texture->id = static_cast<uint32_t>(textures.size());
+    texture->path = imagePath;
+    texture->fd = fd;
+    texture->data_offset = header.data_offset;
+    texture->decode = textureDecodeTable(srgb);
+    for (const LevelRecord& record : records) {
+        int width = static_cast<int>(record.width);
+        int height = static_cast<int>(record.height);
+        texture->levels.push_back({width, height, (width + TILE_SIZE - 1) / TILE_SIZE, static_cast<size_t>(record.first_tile)});
+    }
+    texture->tile_slots.reset(new std::atomic<int32_t>[header.tile_count]);
+    for (uint64_t t = 0; t < header.tile_count; ++t) texture->tile_slots[t].store(-1, std::memory_order_relaxed);
+
+    textures.push_back(std::move(texture));
+    return textures.back().get();
+}
+
+// Counterpart of evict(): the slot is pinned before its key is read, while the evictor clears the
+// key before reading the pins, so one of the two always sees the other
+bool TextureCache::pin(int32_t slot, uint64_t key) {
+    Slot& s = slots[slot];
+    s.pins.fetch_add(1, std::memory_order_seq_cst);
+    if (s.key.load(std::memory_order_seq_cst) == key) {
+        if (!s.referenced.load(std::memory_order_relaxed)) s.referenced.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    s.pins.fetch_sub(1, std::memory_order_release);
+    return false;
+}
+
+// A pinned slot whose tile another lookup is still reading is waited on by itself, not through the mutex
+const uint8_t* TextureCache::hit(int32_t slot) {
+    hits[counterStripe(COUNTER_STRIPES)].value.fetch_add(1, std::memory_order_relaxed);
+    while (slots[slot].loading.load(std::memory_order_acquire)) std::this_thread::yield();
+    return &tile_memory[slot * TILE_BYTES];
+}
+
+const uint8_t* TextureCache::acquire(const CachedTexture& texture, size_t tile, int32_t& slot) {
+    uint64_t key = (static_cast<uint64_t>(texture.id) << TILE_BITS) | tile;
+    slot = texture.tile_slots[tile].load(std::memory_order_acquire);
+    if (slot >= 0 && pin(slot, key)) return hit(slot);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Another thread may have reserved the tile while this one waited
+        slot = texture.tile_slots[tile].load(std::memory_order_acquire);
+        if (slot >= 0 && pin(slot, key)) return hit(slot);
+        misses.value.fetch_add(1, std::memory_order_relaxed);
+
+        // Only the slot is reserved under the lock: published as loading and pinned, so it is not evicted
+        slot = evict();
+        Slot& s = slots[slot];
+        s.loading.store(true, std::memory_order_relaxed);
+        s.referenced.store(true, std::memory_order_relaxed);
+        s.pins.fetch_add(1, std::memory_order_relaxed);
+        s.key.store(key, std::memory_order_seq_cst);
+        texture.tile_slots[tile].store(slot, std::memory_order_release);
+    }
+
+    uint8_t* data = &tile_memory[slot * TILE_BYTES];
+    off_t offset = static_cast<off_t>(texture.data_offset + tile * TILE_BYTES);
+    if (pread(texture.fd, data, TILE_BYTES, offset) != static_cast<ssize_t>(TILE_BYTES)) {
+        std::cerr << "Could not read tile " << tile << " of " << texture.path << std::endl;
+        std::memset(data, 0, TILE_BYTES);
+    }
+    slots[slot].loading.store(false, std::memory_order_release);
+    return data;
+}
+
+// Called with the mutex held; returns a slot no lookup can reach any more
+int32_t TextureCache::evict() {
+    for (;;) {
+        int32_t index = static_cast<int32_t>(clock_hand);
+        clock_hand = (clock_hand + 1) % slot_count;
+        Slot& s = slots[index];
+
+        uint64_t old = s.key.load(std::memory_order_relaxed);
+        if (old == EMPTY_KEY) {
+            resident_tiles.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+        if (s.referenced.exchange(false, std::memory_order_relaxed)) continue;
+        if (s.pins.load(std::memory_order_seq_cst) != 0) continue;
+
+        s.key.store(EMPTY_KEY, std::memory_order_seq_cst);
+        if (s.pins.load(std::memory_order_seq_cst) != 0) {
+            s.key.store(old, std::memory_order_seq_cst);
+            continue;
+        }
+
+        const CachedTexture& owner = *textures[old >> TILE_BITS];
+        owner.tile_slots[old & ((1ull << TILE_BITS) - 1)].store(-1, std::memory_order_relaxed);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+}
+
+TextureCacheStats TextureCache::getStats() const {
+    TextureCacheStats stats;
+    for (const Counter& counter : hits) stats.hits += counter.value.load(std::memory_order_relaxed);
+    stats.misses = misses.value.load(std::memory_order_relaxed);
+    stats.evictions = evictions.load(std::memory_order_relaxed);
+    stats.resident_tiles = resident_tiles.load(std::memory_order_relaxed);
+    stats.capacity_tiles = slot_count;
+    return stats;
+}
@@ -0,0 +1,137 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+/*
+ * Out-of-core texture cache
+ *
+ * Every image is converted once to <image>.rttex: the mip pyramid built by
+ * Texture, cut into TILE_SIZE x TILE_SIZE RGBA8 tiles stored level by level.
+ * Opening a texture only reads its header. A tile is read with pread() the
+ * first time a lookup touches it, into a pool of slots that is sized by the
+ * memory budget and shared by all textures of the cache.
+ *
+ * Hits take no lock. A lookup reads which slot holds the tile, pins that
+ * slot, and checks that the slot still holds the tile. Misses take the
+ * cache mutex only to evict a slot and publish it as loading the tile; the
+ * read happens after the mutex is released, and other lookups of the same
+ * tile wait on that slot until it is loaded. Eviction is CLOCK, which
+ * approximates LRU with one referenced bit per slot. Pinned slots are
+ * skipped, so a tile is never replaced while a lookup is reading it.
+ */
+
+#include "texture.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TextureCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t resident_tiles = 0;
+    size_t capacity_tiles = 0;
+
+    double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+class TextureCache;
+
+// Texture whose tiles are paged in by a TextureCache, sampled like Texture
+class CachedTexture {
+public:
+    ~CachedTexture();
+
+    int getWidth() const { return levels[0].width; }
+    int getHeight() const { return levels[0].height; }
+    int getLevelCount() const { return static_cast<int>(levels.size()); }
+
+    void setMipFilter(MipFilter filter) { mip_filter = filter; }
+    float getLevelOfDetail(const Vec3& duvdx, const Vec3& duvdy) const;
+
+    // Same addressing and filtering as Texture::sample
+    Vec3 sample(float u, float v, float lod = 0.0f) const;
+
+private:
+    friend class TextureCache;
+
+    struct Level {
+        int width;
+        int height;
+        int tiles_x;
+        size_t first_tile;   // Index of the level's first tile in the file
+    };
+
+    TextureCache* cache = nullptr;
+    uint32_t id = 0;
+    std::string path;
+    int fd = -1;
+    uint64_t data_offset = 0;
+    std::vector<Level> levels;
+    const float* decode = nullptr;
+    MipFilter mip_filter = MipFilter::Trilinear;
+    std::unique_ptr<std::atomic<int32_t>[]> tile_slots;   // Tile -> slot holding it, -1 when not resident
+
+    texel_lanes bilinear(const Level& level, float u, float v) const;
+    texel_lanes filter(float u, float v, float lod) const;
+};
+
+class TextureCache {
+public:
+    static const int TILE_SIZE = 64;
+    static const size_t TILE_BYTES = TILE_SIZE * TILE_SIZE * 4;
+
+    explicit TextureCache(size_t budget_bytes);
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // Opens <image>.rttex, converting the image first when the file is missing or stale.
+    // The texture is owned by the cache; opening the same image again returns it.
+    CachedTexture* open(const std::string& imagePath, bool srgb);
+
+    static bool convert(const std::string& imagePath, const std::string& cachePath, bool srgb);
+
+    TextureCacheStats getStats() const;
+
+private:
+    friend class CachedTexture;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> key;          // Texture id and tile of the contents, EMPTY_KEY when free
+        std::atomic<uint32_t> pins;         // Lookups currently reading the tile
+        std::atomic<bool> referenced;       // CLOCK bit, set on every hit
+        std::atomic<bool> loading;          // Reserved for its key, the tile not read yet
+    };
+
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> value{0};
+    };
+
+    static const int COUNTER_STRIPES = 16;  // Hit counters, spread so threads do not share a line
+
+    size_t slot_count;
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<uint8_t[], void (*)(void*)> tile_memory;
+    std::vector<std::unique_ptr<CachedTexture>> textures;
+
+    std::mutex mutex;                       // Reserving slots on a miss, eviction and open()
+    size_t clock_hand = 0;
+    Counter hits[COUNTER_STRIPES];
+    Counter misses;
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<size_t> resident_tiles{0};
+
+    // Pins the slot holding `tile` of `texture`, reading the tile on a miss; release() the returned slot
+    const uint8_t* acquire(const CachedTexture& texture, size_t tile, int32_t& slot);
+    void release(int32_t slot) { slots[slot].pins.fetch_sub(1, std::memory_order_release); }
+    const uint8_t* hit(int32_t slot);
+
+    bool pin(int32_t slot, uint64_t key);
+    int32_t evict();
+};
+
+#endif // TEXTURE_CACHE_H
@@ -0,0 +1,423 @@
+#include "tile_farm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    enum MessageType : uint32_t {
+        COMMAND_LINE = 1,   // Coordinator -> worker: the arguments, each NUL terminated
+        FRAME = 2,          // Worker -> coordinator: frame number, width, height, tile count
+        RANGE = 3,          // Coordinator -> worker: first tile, tile count
+        TILE = 4,           // Worker -> coordinator: tile index, then the tile's RGB8 rows
+        FRAME_DONE = 5      // Coordinator -> worker: no more ranges in this frame
+    };
+
+    struct MessageHeader {
+        uint32_t type;
+        uint32_t length;
+    };
+
+    const uint32_t MAX_MESSAGE_BYTES = 1 << 24;
+    const size_t MAX_RANGE_TILES = 64;
+    const int POLL_INTERVAL_MS = 250;
+
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;                // -1 once the worker has failed
+        bool ready = false;         // Reached the current frame
+        bool busy = false;          // Has a range in progress
+        bool duplicated = false;    // Its range is also being rendered by another worker
+        size_t first = 0;
+        size_t count = 0;
+        size_t delivered = 0;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point last_heard;
+    };
+
+    FarmRole role = FarmRole::None;
+    double timeout_seconds = 30.0;
+    uint32_t frame = 0;
+    int coordinator_fd = -1;
+
+    // Closing the sockets ends the workers; they are waited for so none outlives the coordinator
+    struct Workers {
+        std::vector<Worker> list;
+
+        ~Workers() {
+            for (Worker& worker : list) {
+                if (worker.fd >= 0) close(worker.fd);
+            }
+            for (Worker& worker : list) {
+                if (worker.fd >= 0) waitpid(worker.pid, nullptr, 0);
+            }
+        }
+    } workers;
+
+    bool writeAll(int fd, const void* data, size_t bytes) {
+        const char* position = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t written = send(fd, position, bytes, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            position += written;
+            bytes -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool readAll(int fd, void* data, size_t bytes) {
+        char* position = static_cast<char*>(data);
+        while (bytes > 0) {
+            ssize_t received = recv(fd, position, bytes, 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+            position += received;
+            bytes -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    bool sendMessage(int fd, uint32_t type, const void* payload, size_t length) {
+        MessageHeader header{type, static_cast<uint32_t>(length)};
+        return writeAll(fd, &header, sizeof(header)) && (length == 0 || writeAll(fd, payload, length));
+    }
+
+    bool receiveMessage(int fd, uint32_t& type, std::vector<char>& payload) {
+        MessageHeader header;
+        if (!readAll(fd, &header, sizeof(header)) || header.length > MAX_MESSAGE_BYTES) return false;
+        payload.resize(header.length);
+        if (header.length > 0 && !readAll(fd, payload.data(), header.length)) return false;
+        type = header.type;
+        return true;
+    }
+
+    // Runs argv[0] again through /proc/self/exe, with one end of a socket pair as --farm-worker
+    bool spawnWorker(const char* program, const std::string& command_line) {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) return false;
+        std::string fd_text = std::to_string(sockets[1]);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(sockets[0]);
+            close(sockets[1]);
+            return false;
+        }
+        if (pid == 0) {
+            fcntl(sockets[1], F_SETFD, 0);
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+            char* arguments[] = {const_cast<char*>(program), const_cast<char*>("--farm-worker"), fd_text.data(), nullptr};
+            execv("/proc/self/exe", arguments);
+            _exit(127);
+        }
+        close(sockets[1]);
+
+        Worker worker;
+        worker.pid = pid;
+        worker.fd = sockets[0];
+        if (!sendMessage(worker.fd, COMMAND_LINE, command_line.data(), command_line.size())) {
+            close(worker.fd);
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            return false;
+        }
+        workers.list.push_back(worker);
+        return true;
+    }
+}
+
+bool setupTileFarm(int& argc, char**& argv) {
+    static std::vector<std::string> arguments;
+    static std::vector<char*> pointers;
+
+    int worker_count = 0;
+    int worker_fd = -1;
+    arguments.assign(1, argv[0]);
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--farm") == 0 || strcmp(argv[i], "--farm-timeout") == 0 || strcmp(argv[i], "--farm-worker") == 0) {
+            if (!has_value) {
+                std::cerr << argv[i] << " needs a value" << std::endl;
+                return false;
+            }
+            if (strcmp(argv[i], "--farm") == 0) {
+                worker_count = std::atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--farm-timeout") == 0) {
+                timeout_seconds = std::max(0.1, std::atof(argv[++i]));
+            } else {
+                worker_fd = std::atoi(argv[++i]);
+            }
+        } else {
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    if (worker_fd >= 0) {
+        role = FarmRole::Worker;
+        coordinator_fd = worker_fd;
+
+        uint32_t type;
+        std::vector<char> payload;
+        if (!receiveMessage(coordinator_fd, type, payload) || type != COMMAND_LINE) {
+            std::cerr << "Farm worker got no command line from its coordinator" << std::endl;
+            return false;
+        }
+        for (size_t start = 0; start < payload.size();) {
+            size_t end = std::find(payload.begin() + start, payload.end(), '\0') - payload.begin();
+            arguments.emplace_back(payload.data() + start, end - start);
+            start = end + 1;
+        }
+    } else if (worker_count > 0) {
+        role = FarmRole::Coordinator;
+
+        std::string command_line;
+        for (size_t i = 1; i < arguments.size(); ++i) {
+            command_line += arguments[i];
+            command_line += '\0';
+        }
+        for (int i = 0; i < worker_count; ++i) {
+            if (!spawnWorker(argv[0], command_line)) {
+                std::cerr << "Could not start farm worker " << i << ": " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    pointers.clear();
+    for (std::string& argument : arguments) pointers.push_back(argument.data());
+    pointers.push_back(nullptr);
+    argc = static_cast<int>(arguments.size());
+    argv = pointers.data();
+    return true;
+}
+
+FarmRole tileFarmRole() {
+    return role;
+}
+
+std::vector<Tile> farmTiles(unsigned char* image, int width, int height, const std::vector<Tile>& tiles) {
+    ++frame;
+    auto now = std::chrono::steady_clock::now();
+
+    size_t live = 0;
+    for (Worker& worker : workers.list) {
+        worker.ready = false;
+        worker.busy = false;
+        worker.last_heard = now;
+        if (worker.fd >= 0) live++;
+    }
+
+    // Ranges of consecutive tiles: a few per worker, so fast workers take more of them
+    std::deque<std::pair<size_t, size_t>> ranges;
+    size_t range_tiles = std::clamp<size_t>(tiles.size() / (std::max<size_t>(live, 1) * 8), 1, MAX_RANGE_TILES);
+    for (size_t first = 0; first < tiles.size(); first += range_tiles) {
+        ranges.emplace_back(first, std::min(range_tiles, tiles.size() - first));
+    }
+
+    std::vector<bool> done(tiles.size(), false);
+    size_t remaining = tiles.size();
+
+    // The unfinished tiles of a failed worker's range go back to the front of the queue
+    auto fail = [&](Worker& worker, const char* reason) {
+        std::cerr << "Farm worker " << worker.pid << " " << reason << "; its tiles go to the others" << std::endl;
+        kill(worker.pid, SIGKILL);
+        close(worker.fd);
+        waitpid(worker.pid, nullptr, 0);
+        worker.fd = -1;
+        if (worker.busy) {
+            for (size_t end = worker.first + worker.count; end > worker.first;) {
+                if (done[end - 1]) {
+                    --end;
+                    continue;
+                }
+                size_t start = end;
+                while (start > worker.first && !done[start - 1]) --start;
+                ranges.emplace_front(start, end - start);
+                end = start;
+            }
+        }
+        worker.busy = false;
+        worker.ready = false;
+    };
+
+    auto assign = [&](Worker& worker, size_t first, size_t count) {
+        worker.busy = true;
+        worker.duplicated = false;
+        worker.first = first;
+        worker.count = count;
+        worker.delivered = 0;
+        worker.started = worker.last_heard = std::chrono::steady_clock::now();
+        uint32_t range[2] = {static_cast<uint32_t>(first), static_cast<uint32_t>(count)};
+        if (!sendMessage(worker.fd, RANGE, range, sizeof(range))) fail(worker, "stopped reading");
+    };
+
+    std::vector<char> payload;
+    while (remaining > 0) {
+        for (Worker& worker : workers.list) {
+            if (worker.fd < 0 || !worker.ready || worker.busy) continue;
+            if (!ranges.empty()) {
+                auto [first, count] = ranges.front();
+                ranges.pop_front();
+                assign(worker, first, count);
+                continue;
+            }
+
+            // Nothing left to hand out: the idle worker also renders what is left of the oldest range in
+            // progress, and whichever copy of a tile arrives first is kept
+            Worker* slowest = nullptr;
+            for (Worker& other : workers.list) {
+                if (other.fd < 0 || !other.busy || other.duplicated) continue;
+                if (!slowest || other.started < slowest->started) slowest = &other;
+            }
+            if (!slowest) continue;
+            size_t first = slowest->first + slowest->delivered;
+            size_t end = slowest->first + slowest->count;
+            while (first < end && done[first]) ++first;
+            if (first == end) continue;
+            slowest->duplicated = true;
+            assign(worker, first, end - first);
+            worker.duplicated = true;
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<Worker*> polled;
+        for (Worker& worker : workers.list) {
+            if (worker.fd < 0) continue;
+            fds.push_back({worker.fd, POLLIN, 0});
+            polled.push_back(&worker);
+        }
+        if (fds.empty()) break;
+        if (poll(fds.data(), fds.size(), POLL_INTERVAL_MS) < 0 && errno != EINTR) break;
+
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fds.size(); ++i) {
+            Worker& worker = *polled[i];
+            if (fds[i].revents == 0 || worker.fd < 0) continue;
+
+            uint32_t type;
+            if (!receiveMessage(worker.fd, type, payload)) {
+                fail(worker, "exited");
+                continue;
+            }
+            worker.last_heard = now;
+
+            if (type == FRAME && payload.size() == 4 * sizeof(uint32_t)) {
+                uint32_t info[4];
+                std::memcpy(info, payload.data(), sizeof(info));
+                if (info[0] < frame) {
+                    // Arrived after its frame was finished without it
+                    if (!sendMessage(worker.fd, FRAME_DONE, nullptr, 0)) fail(worker, "stopped reading");
+                } else if (info[0] != frame || info[1] != static_cast<uint32_t>(width) || info[2] != static_cast<uint32_t>(height) || info[3] != tiles.size()) {
+                    fail(worker, "is rendering a different frame");
+                } else {
+                    worker.ready = true;
+                }
+            } else if (type == TILE && !worker.ready) {
+                // Rest of a range whose frame was finished by another worker's copy
+            } else if (type == TILE && worker.busy && payload.size() >= sizeof(uint32_t)) {
+                uint32_t index;
+                std::memcpy(&index, payload.data(), sizeof(index));
+                if (index < worker.first || index >= worker.first + worker.count) {
+                    fail(worker, "sent a tile it was not given");
+                    continue;
+                }
+                const Tile& tile = tiles[index];
+                size_t row_bytes = static_cast<size_t>(tile.x1 - tile.x0) * 3;
+                if (payload.size() != sizeof(index) + row_bytes * (tile.y1 - tile.y0)) {
+                    fail(worker, "sent a malformed tile");
+                    continue;
+                }
+                if (!done[index]) {
+                    for (int y = tile.y0; y < tile.y1; ++y) {
+                        std::memcpy(image + (static_cast<size_t>(y) * width + tile.x0) * 3,
+                                    payload.data() + sizeof(index) + (y - tile.y0) * row_bytes, row_bytes);
+                    }
+                    done[index] = true;
+                    --remaining;
+                }
+                if (++worker.delivered == worker.count) worker.busy = false;
+            } else {
+                fail(worker, "sent an unexpected message");
+            }
+        }
+
+        // Busy workers must keep delivering, and all must reach the frame
+        for (Worker& worker : workers.list) {
+            if (worker.fd < 0 || (worker.ready && !worker.busy)) continue;
+            if (std::chrono::duration<double>(now - worker.last_heard).count() > timeout_seconds) fail(worker, "timed out");
+        }
+    }
+
+    for (Worker& worker : workers.list) {
+        if (worker.fd >= 0 && worker.ready && !sendMessage(worker.fd, FRAME_DONE, nullptr, 0)) fail(worker, "stopped reading");
+    }
+
+    std::vector<Tile> left;
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        if (!done[i]) left.push_back(tiles[i]);
+    }
+    return left;
+}
+
+bool serveTiles(const unsigned char* image, int width, int height, const std::vector<Tile>& tiles,
+                const std::function<void(const std::vector<Tile>&)>& render) {
+    ++frame;
+    uint32_t info[4] = {frame, static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(tiles.size())};
+    if (!sendMessage(coordinator_fd, FRAME, info, sizeof(info))) return false;
+
+    std::vector<char> payload;
+    std::vector<char> message;
+    for (;;) {
+        uint32_t type;
+        if (!receiveMessage(coordinator_fd, type, payload)) return false;
+        if (type == FRAME_DONE) return true;
+
+        uint32_t range[2];
+        if (type != RANGE || payload.size() != sizeof(range)) return false;
+        std::memcpy(range, payload.data(), sizeof(range));
+        size_t first = range[0];
+        size_t count = range[1];
+        if (first > tiles.size() || count > tiles.size() - first) return false;
+
+        // A tile per hardware thread at a time, so the coordinator hears from the worker while a range is in progress
+        size_t batch = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t start = first; start < first + count; start += batch) {
+            // The frame ends early when another worker's copy of this range finished first
+            pollfd pending = {coordinator_fd, POLLIN, 0};
+            if (start > first && poll(&pending, 1, 0) > 0) {
+                if (!receiveMessage(coordinator_fd, type, payload)) return false;
+                return type == FRAME_DONE;
+            }
+
+            size_t end = std::min(start + batch, first + count);
+            render(std::vector<Tile>(tiles.begin() + start, tiles.begin() + end));
+
+            for (size_t i = start; i < end; ++i) {
+                const Tile& tile = tiles[i];
+                size_t row_bytes = static_cast<size_t>(tile.x1 - tile.x0) * 3;
+                uint32_t index = static_cast<uint32_t>(i);
+                message.resize(sizeof(index) + row_bytes * (tile.y1 - tile.y0));
+                std::memcpy(message.data(), &index, sizeof(index));
+                for (int y = tile.y0; y < tile.y1; ++y) {
+                    std::memcpy(message.data() + sizeof(index) + (y - tile.y0) * row_bytes,
+                                image + (static_cast<size_t>(y) * width + tile.x0) * 3, row_bytes);
+                }
+                if (!sendMessage(coordinator_fd, TILE, message.data(), message.size())) return false;
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TILE_FARM_H
+#define TILE_FARM_H
+
+/*
+ * Tile farm: one frame shared between processes
+ *
+ * `--farm <n>` on the command line of a renderer makes it the coordinator
+ * of n worker processes. setupTileFarm() strips the farm options and starts
+ * the workers, each the same executable with a socket to the coordinator.
+ * The scene is described by the rest of the command line: each worker
+ * receives it over its socket and builds the scene the way the coordinator
+ * does, while the coordinator builds its own.
+ *
+ * Both sides then reach renderImage(). The coordinator hands out ranges of
+ * consecutive tiles to idle workers, copies the tiles they send back into
+ * its image and, when a worker dies or sends nothing for `--farm-timeout`
+ * seconds, kills it and hands its unfinished tiles to the others. Once no
+ * ranges are left, an idle worker also gets the rest of the oldest range
+ * still in progress, so one slow worker does not hold up the frame; the
+ * first copy of a tile to arrive is kept. Tiles no worker delivered are
+ * rendered by the coordinator itself, so a frame always completes. Every tile is rendered by the same code as in a single
+ * process, so the image is identical.
+ *
+ * Workers stay up for all the frames of a run, since both sides call
+ * renderImage() in the same sequence. Their films only hold the tiles they
+ * rendered, so the executables skip saving images when tileFarmRole() is
+ * Worker, and their standard output goes to /dev/null. A worker whose coordinator is gone
+ * exits.
+ *
+ * Messages are a type and a length followed by the payload, over a Unix
+ * stream socket; a TCP socket would carry them unchanged.
+ */
+
+#include "tile_scheduler.h"
+#include <functional>
+#include <vector>
+
+enum class FarmRole {
+    None,
+    Coordinator,
+    Worker
+};
+
+// Call first thing in main(). Removes --farm, --farm-timeout and --farm-worker from the command line;
+// a worker gets the coordinator's command line instead of its own. False on malformed farm options.
+bool setupTileFarm(int& argc, char**& argv);
+
+FarmRole tileFarmRole();
+
+// Coordinator: has the workers render `tiles` of a width x height RGB8 image and copies them in.
+// Returns the tiles that no worker delivered.
+std::vector<Tile> farmTiles(unsigned char* image, int width, int height, const std::vector<Tile>& tiles);
+
+// Worker: renders the tile ranges the coordinator asks for with render(subset), which fills `image`,
+// and sends them back. True at the end of the frame, false once the coordinator is gone.
+bool serveTiles(const unsigned char* image, int width, int height, const std::vector<Tile>& tiles,
+                const std::function<void(const std::vector<Tile>&)>& render);
+
+#endif // TILE_FARM_H
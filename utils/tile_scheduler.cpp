@@ -0,0 +1,243 @@
+#include "tile_scheduler.h"
+#include "numa.h"
+#include <cstdint>
+#include <utility>
+
+namespace {
+    unsigned shared_thread_count = 0;
+    bool shared_pinning = false;
+    thread_local int current_node = 0;
+}
+
+TaskPool::TaskPool(unsigned thread_count, bool pin) : pinned(pin) {
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    queues.reset(new Queue[thread_count]);
+
+    // Pinned workers take the CPUs node by node; unpinned ones all count as node 0
+    std::vector<std::pair<int, int>> slots;
+    const NumaTopology& topology = NumaTopology::get();
+    for (int node = 0; node < topology.getNodeCount(); ++node) {
+        for (int cpu : topology.getCpus(node)) slots.emplace_back(node, cpu);
+    }
+    for (unsigned i = 0; i < thread_count; ++i) {
+        bool has_slot = pin && !slots.empty();
+        worker_nodes.push_back(has_slot ? slots[i % slots.size()].first : 0);
+        worker_cpus.push_back(has_slot ? slots[i % slots.size()].second : -1);
+    }
+
+    victims.resize(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        for (int same_node = 1; same_node >= 0; --same_node) {
+            for (unsigned j = 1; j < thread_count; ++j) {
+                unsigned victim = (i + j) % thread_count;
+                if ((worker_nodes[victim] == worker_nodes[i]) == (same_node == 1)) victims[i].push_back(victim);
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back(&TaskPool::work, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+TaskPool& TaskPool::shared() {
+    static TaskPool pool(shared_thread_count, shared_pinning);
+    return pool;
+}
+
+void TaskPool::setSharedThreadCount(unsigned threads) {
+    shared_thread_count = threads;
+}
+
+void TaskPool::setSharedPinning(bool pin) {
+    shared_pinning = pin;
+}
+
+int TaskPool::currentNode() {
+    return current_node;
+}
+
+std::vector<TaskPoolNodeStats> TaskPool::getNodeStats() const {
+    std::vector<TaskPoolNodeStats> stats;
+    for (unsigned i = 0; i < getThreadCount(); ++i) {
+        if (static_cast<size_t>(worker_nodes[i]) >= stats.size()) stats.resize(worker_nodes[i] + 1);
+        TaskPoolNodeStats& node = stats[worker_nodes[i]];
+        node.workers++;
+        node.tasks += queues[i].tasks;
+        node.remote_steals += queues[i].remote_steals;
+    }
+    return stats;
+}
+
+void TaskPool::run(size_t count, const std::function<void(size_t, unsigned)>& run_task) {
+    if (count == 0) return;
+    remaining.store(count, std::memory_order_relaxed);
+    task.store(&run_task, std::memory_order_release);
+
+    // Contiguous blocks keep neighbouring tasks on one worker until stealing kicks in
+    unsigned workers = getThreadCount();
+    for (unsigned w = 0; w < workers; ++w) {
+        std::lock_guard<std::mutex> lock(queues[w].mutex);
+        for (size_t i = count * w / workers; i < count * (w + 1) / workers; ++i) {
+            queues[w].items.push_back(i);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ++generation;
+    wake.notify_all();
+    done.wait(lock, [this] { return remaining.load(std::memory_order_acquire) == 0; });
+}
+
+// Own queue from the back, then the others from the front, same node first
+bool TaskPool::next(unsigned worker, size_t& item) {
+    {
+        Queue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            item = own.items.back();
+            own.items.pop_back();
+            return true;
+        }
+    }
+    for (unsigned victim : victims[worker]) {
+        Queue& queue = queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.items.empty()) {
+            item = queue.items.front();
+            queue.items.pop_front();
+            if (worker_nodes[victim] != worker_nodes[worker]) queues[worker].remote_steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::work(unsigned worker) {
+    if (worker_cpus[worker] >= 0) pinThreadToCpu(worker_cpus[worker]);
+    current_node = worker_nodes[worker];
+
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        // The task is read after each pop: a worker still draining may already get items of the next run
+        size_t item;
+        while (next(worker, item)) {
+            (*task.load(std::memory_order_acquire))(item, worker);
+            queues[worker].tasks++;
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+}
+
+const char* curveOrderName(CurveOrder order) {
+    switch (order) {
+        case CurveOrder::Morton: return "morton";
+        case CurveOrder::Hilbert: return "hilbert";
+        case CurveOrder::Scanline:
+        default: return "scanline";
+    }
+}
+
+bool parseCurveOrder(const std::string& name, CurveOrder& order) {
+    for (CurveOrder candidate : {CurveOrder::Scanline, CurveOrder::Morton, CurveOrder::Hilbert}) {
+        if (name == curveOrderName(candidate)) {
+            order = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+    // 0000abcd -> 0a0b0c0d
+    uint32_t partBy1(uint32_t x) {
+        x &= 0x0000ffff;
+        x = (x | (x << 8)) & 0x00ff00ff;
+        x = (x | (x << 4)) & 0x0f0f0f0f;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    }
+
+    // Distance of (x, y) along the Hilbert curve through a side x side grid, side a power of two
+    uint32_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y) {
+        uint32_t index = 0;
+        for (uint32_t s = side / 2; s > 0; s /= 2) {
+            uint32_t rx = (x & s) ? 1 : 0;
+            uint32_t ry = (y & s) ? 1 : 0;
+            index += s * s * ((3 * rx) ^ ry);
+            // Rotate the quadrant so the curve inside it starts at its origin
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = side - 1 - x;
+                    y = side - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return index;
+    }
+}
+
+// Grids that are not square powers of two take the cells they contain from the enclosing one
+std::vector<std::pair<int, int>> curveSequence(int columns, int rows, CurveOrder order) {
+    uint32_t side = 1;
+    while (side < static_cast<uint32_t>(std::max(columns, rows))) side *= 2;
+
+    std::vector<std::pair<uint32_t, std::pair<int, int>>> keyed;
+    keyed.reserve(static_cast<size_t>(std::max(columns, 0)) * std::max(rows, 0));
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < columns; ++x) {
+            uint32_t key;
+            switch (order) {
+                case CurveOrder::Morton: key = partBy1(x) | (partBy1(y) << 1); break;
+                case CurveOrder::Hilbert: key = hilbertIndex(side, x, y); break;
+                case CurveOrder::Scanline:
+                default: key = static_cast<uint32_t>(y) * columns + x; break;
+            }
+            keyed.push_back({key, {x, y}});
+        }
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<std::pair<int, int>> cells;
+    cells.reserve(keyed.size());
+    for (const auto& entry : keyed) cells.push_back(entry.second);
+    return cells;
+}
+
+std::vector<Tile> imageTiles(int width, int height, const TileOrder& order) {
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    std::vector<Tile> tiles;
+    tiles.reserve(static_cast<size_t>(tiles_x) * tiles_y);
+    for (const auto& [tx, ty] : curveSequence(tiles_x, tiles_y, order.tiles)) {
+        Tile tile;
+        tile.x0 = tx * TILE_SIZE;
+        tile.y0 = ty * TILE_SIZE;
+        tile.x1 = std::min(tile.x0 + TILE_SIZE, width);
+        tile.y1 = std::min(tile.y0 + TILE_SIZE, height);
+        tiles.push_back(tile);
+    }
+    return tiles;
+}
@@ -0,0 +1,200 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+/*
+ * Parallel image rendering
+ *
+ * TaskPool keeps its worker threads alive between runs. Each run splits its
+ * task indices into one contiguous block per worker. A worker pops from the
+ * back of its own deque and, once that is empty, steals from the front of
+ * the others', so uneven tiles balance out while neighbouring tiles
+ * mostly stay on one core.
+ *
+ * A pinned pool binds every worker to one CPU, filling NUMA nodes one after
+ * the other, so consecutive workers (and the blocks they start with) share
+ * a node. Idle workers steal from their own node first and count what they
+ * take from other nodes.
+ *
+ * renderTiles() splits an image into TILE_SIZE x TILE_SIZE tiles, one task
+ * each. A tile is shaded into a cache-line aligned buffer on the worker's
+ * stack and copied into the image in one pass, so workers never write to
+ * the same cache line while shading. renderTileRuns() hands out runs of
+ * consecutive pixels instead of single ones, for shading code that works on
+ * packets.
+ *
+ * Tiles, and the pixels within a tile, are visited along a TileOrder curve.
+ * Morton and Hilbert orders keep consecutive pixels, and so the geometry
+ * and texels they touch, close together in the image; since each worker
+ * starts on a contiguous block of tiles, it also works on a compact region
+ * rather than a band of rows. Eight consecutive pixels of either curve form
+ * a 4x2 or 2x4 block, which packets of rays share better than a row of 8.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TaskPoolNodeStats {
+    unsigned workers = 0;
+    size_t tasks = 0;           // Tasks run by the node's workers
+    size_t remote_steals = 0;   // Of those, tasks taken from workers on other nodes
+};
+
+class TaskPool {
+public:
+    // 0 threads = one per hardware thread; `pin` binds each worker to one CPU, grouped by NUMA node
+    explicit TaskPool(unsigned threads = 0, bool pin = false);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    unsigned getThreadCount() const { return static_cast<unsigned>(threads.size()); }
+    bool isPinned() const { return pinned; }
+    int getWorkerNode(unsigned worker) const { return worker_nodes[worker]; }
+
+    // NUMA node of the calling worker; 0 outside pool workers and in pools that are not pinned
+    static int currentNode();
+
+    // Totals since the pool started, per NUMA node; only valid between runs
+    std::vector<TaskPoolNodeStats> getNodeStats() const;
+
+    // Runs task(index, worker) for every index in [0, count) and returns once all have finished.
+    // One run at a time, and never from inside a task.
+    void run(size_t count, const std::function<void(size_t, unsigned)>& task);
+
+    // Process-wide pool shared by the renderers; thread count and pinning only apply before its first use
+    static TaskPool& shared();
+    static void setSharedThreadCount(unsigned threads);
+    static void setSharedPinning(bool pin);
+
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+        size_t tasks = 0;            // Only written by the owning worker
+        size_t remote_steals = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Queue[]> queues;
+    bool pinned;
+    std::vector<int> worker_cpus;                   // -1 when not pinned
+    std::vector<int> worker_nodes;
+    std::vector<std::vector<unsigned>> victims;     // Per worker: same-node workers first, then the rest
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::atomic<const std::function<void(size_t, unsigned)>*> task{nullptr};   // Published before the items
+    unsigned long generation = 0;           // Bumped by every run()
+    bool stopping = false;
+    std::atomic<size_t> remaining{0};
+
+    void work(unsigned worker);
+    bool next(unsigned worker, size_t& item);
+};
+
+struct Tile {
+    int x0, y0;     // First pixel
+    int x1, y1;     // One past the last pixel
+};
+
+const int TILE_SIZE = 32;
+
+enum class CurveOrder {
+    Scanline,   // Row by row
+    Morton,     // Z-order: the bits of x and y interleaved
+    Hilbert     // Every step moves to an edge neighbour
+};
+
+const char* curveOrderName(CurveOrder order);
+bool parseCurveOrder(const std::string& name, CurveOrder& order);
+
+struct TileOrder {
+    CurveOrder tiles = CurveOrder::Hilbert;
+    CurveOrder pixels = CurveOrder::Hilbert;
+};
+
+// Every cell (x, y) of a columns x rows grid, in curve order
+std::vector<std::pair<int, int>> curveSequence(int columns, int rows, CurveOrder order);
+
+const int MAX_RUN_LENGTH = 8;
+
+// Consecutive pixels of one tile in its pixel order
+struct PixelRun {
+    int count;
+    int x[MAX_RUN_LENGTH];
+    int y[MAX_RUN_LENGTH];
+    unsigned char* rgb[MAX_RUN_LENGTH];     // Where each pixel's RGB8 value goes
+};
+
+// The TILE_SIZE x TILE_SIZE tiles covering a width x height image, in the tile order
+std::vector<Tile> imageTiles(int width, int height, const TileOrder& order);
+
+// Calls run(pixel_run) for every pixel of `tiles` in a width x height RGB8 image, in runs of up to `run_length`
+// (at most MAX_RUN_LENGTH) pixels in `pixel_order`, one tile per task on `pool`
+template <typename Run>
+void renderTileRuns(TaskPool& pool, unsigned char* image, int width, const std::vector<Tile>& tiles, CurveOrder pixel_order, int run_length, Run&& run) {
+    std::vector<std::pair<int, int>> pixels = curveSequence(TILE_SIZE, TILE_SIZE, pixel_order);
+    run_length = std::clamp(run_length, 1, MAX_RUN_LENGTH);
+
+    pool.run(tiles.size(), [&](size_t index, unsigned) {
+        const Tile& tile = tiles[index];
+        int tile_width = tile.x1 - tile.x0;
+        int tile_height = tile.y1 - tile.y0;
+
+        // Edge tiles skip the part of the curve outside the image
+        alignas(64) unsigned char buffer[TILE_SIZE * TILE_SIZE * 3];
+        PixelRun pixel_run;
+        pixel_run.count = 0;
+        for (const auto& [dx, dy] : pixels) {
+            if (dx >= tile_width || dy >= tile_height) continue;
+            int i = pixel_run.count++;
+            pixel_run.x[i] = tile.x0 + dx;
+            pixel_run.y[i] = tile.y0 + dy;
+            pixel_run.rgb[i] = buffer + (dy * tile_width + dx) * 3;
+            if (pixel_run.count == run_length) {
+                run(static_cast<const PixelRun&>(pixel_run));
+                pixel_run.count = 0;
+            }
+        }
+        if (pixel_run.count > 0) run(static_cast<const PixelRun&>(pixel_run));
+
+        int row_bytes = tile_width * 3;
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            std::memcpy(image + (static_cast<size_t>(y) * width + tile.x0) * 3, buffer + (y - tile.y0) * row_bytes, row_bytes);
+        }
+    });
+}
+
+// renderTileRuns() over the whole image
+template <typename Run>
+void renderTileRuns(TaskPool& pool, unsigned char* image, int width, int height, const TileOrder& order, int run_length, Run&& run) {
+    renderTileRuns(pool, image, width, imageTiles(width, height, order), order.pixels, run_length, std::forward<Run>(run));
+}
+
+// Calls pixel(x, y, rgb) for every pixel of a width x height RGB8 image, on all threads of `pool`
+template <typename Pixel>
+void renderTiles(TaskPool& pool, unsigned char* image, int width, int height, Pixel&& pixel) {
+    renderTileRuns(pool, image, width, height, TileOrder(), 1, [&](const PixelRun& run) {
+        pixel(run.x[0], run.y[0], run.rgb[0]);
+    });
+}
+
+// renderTiles() on the shared pool
+template <typename Pixel>
+void renderTiles(unsigned char* image, int width, int height, Pixel&& pixel) {
+    renderTiles(TaskPool::shared(), image, width, height, std::forward<Pixel>(pixel));
+}
+
+#endif // TILE_SCHEDULER_H
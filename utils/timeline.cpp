@@ -0,0 +1,45 @@
+#include "timeline.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+    const int BAR_WIDTH = 40;
+}
+
+double Timeline::elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Timeline::record(const std::string& name, double begin, double end) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.push_back({name, begin, end});
+}
+
+void Timeline::print(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Stage> sorted = stages;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Stage& a, const Stage& b) { return a.begin < b.begin; });
+
+    double total = 0.0;
+    size_t name_width = 0;
+    for (const Stage& stage : sorted) {
+        total = std::max(total, stage.end);
+        name_width = std::max(name_width, stage.name.size());
+    }
+    if (total <= 0.0) return;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    for (const Stage& stage : sorted) {
+        int from = static_cast<int>(stage.begin / total * BAR_WIDTH);
+        int to = std::max(from + 1, static_cast<int>(stage.end / total * BAR_WIDTH + 0.5));
+        std::string bar(BAR_WIDTH, ' ');
+        std::fill(bar.begin() + from, bar.begin() + std::min(to, BAR_WIDTH), '#');
+        out << "  " << std::left << std::setw(static_cast<int>(name_width)) << stage.name << std::right
+            << " |" << bar << "| " << std::setw(8) << stage.begin * 1000.0 << " -> " << std::setw(8) << stage.end * 1000.0
+            << " ms (" << (stage.end - stage.begin) * 1000.0 << " ms)\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
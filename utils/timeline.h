@@ -0,0 +1,51 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+/*
+ * Wall-clock timeline of named stages that may run on different threads,
+ * printed as bars on a shared time axis so overlapping stages are visible.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Timeline {
+public:
+    Timeline() : start(std::chrono::steady_clock::now()) {}
+
+    // Runs `work` on the calling thread as the stage `name` and returns its result
+    template <typename Work>
+    auto stage(const std::string& name, Work&& work) -> decltype(work()) {
+        double begin = elapsed();
+        struct Record {
+            Timeline& timeline;
+            const std::string& name;
+            double begin;
+            ~Record() { timeline.record(name, begin, timeline.elapsed()); }
+        } record{*this, name, begin};
+        return work();
+    }
+
+    // Seconds since the timeline was created
+    double elapsed() const;
+
+    void print(std::ostream& out) const;
+
+private:
+    struct Stage {
+        std::string name;
+        double begin;
+        double end;
+    };
+
+    std::chrono::steady_clock::time_point start;
+    mutable std::mutex mutex;
+    std::vector<Stage> stages;
+
+    void record(const std::string& name, double begin, double end);
+};
+
+#endif // TIMELINE_H
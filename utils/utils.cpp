@@ -2,6 +2,8 @@
 #include "stb_image_write.h"
 
 #include "utils.h"
+#include <cstdlib>
+#include <memory>
 
 Vec3 wrap_around(const Vec3& v) {
     float x = v.x - std::floor(v.x);
@@ -12,4 +14,9 @@ Vec3 wrap_around(const Vec3& v) {
 
 void save_png(const std::string& filename, const unsigned char* data, int width, int height) {
     stbi_write_png(filename.c_str(), width, height, 3, data, width * 3);
-}
\ No newline at end of file
+}
+
+std::string absolute_path(const std::string& path) {
+    std::unique_ptr<char, decltype(&std::free)> resolved(realpath(path.c_str(), nullptr), &std::free);
+    return resolved ? std::string(resolved.get()) : path;
+}
@@ -7,5 +7,7 @@
 
 Vec3 wrap_around(const Vec3& v);
 void save_png(const std::string& filename, const unsigned char* data, int width, int height);
+// The path itself when it cannot be resolved, e.g. because the file is missing
+std::string absolute_path(const std::string& path);
 
 #endif // UTILS_H
\ No newline at end of file
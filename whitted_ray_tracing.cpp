@@ -5,82 +5,147 @@
 #include <vector>
 #include <memory>
 #include <cstring>
+#include <chrono>
 #include "vec3.h"
 #include "material.h"
 #include "geometry.h"
 #include "optics.h"
 #include "primitive_tree.h"
+#include "renderer.h"
+#include "tile_farm.h"
 
-Vec3 cast_ray(const Ray& ray, const PrimitiveTree& primitives, const std::vector<Light*>& lights, int depth, int max_bounces, const Vec3& background_color) {
-    if (depth > max_bounces) return background_color;
-
-    float t;
-    Primitive* hitPrimitive;
+// Diffuse and specular light reaching a non-reflective surface, with shadow rays to every light
+Vec3 direct_lighting(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Primitive* hitPrimitive, const PrimitiveTree& primitives, const std::vector<Light*>& lights) {
+    Vec3 color(0.0f, 0.0f, 0.0f);
+    for (const auto& light : lights) {
+        Vec3 light_direction = (light->position - hit_point).normalize();
+        float light_intensity = light->intensity;
+
+        float light_distance_2 = (light->position - hit_point).dot(light->position - hit_point);
+
+        Ray shadow_ray(hit_point + normal * 1e-3, light_direction);
+        float tShadow;
+        Primitive* shadowHitPrimitive;
+        bool isInShadow = primitives.intersect(shadow_ray, tShadow, shadowHitPrimitive) && tShadow * tShadow < light_distance_2;
+
+        if (!isInShadow) {
+            Vec3 diffuse = hitPrimitive->material.color * hitPrimitive->material.kD * light_intensity * std::max(0.0f, light_direction.dot(normal));
+            Vec3 reflected_direction = (ray.direction - normal * ray.direction.dot(normal) * 2).normalize();
+            Vec3 specular = Vec3(1.0f) * hitPrimitive->material.kS * light_intensity * std::pow(std::max(0.0f, reflected_direction.dot(-light_direction)), hitPrimitive->material.shininess);
+            color += diffuse + specular;
+        }
+    }
+    return color;
+}
 
-    if (!primitives.intersect(ray, t, hitPrimitive)) {
-        return background_color;
+// A ray waiting in the queue; `weight` is the share of its radiance that reaches the pixel
+struct QueuedRay {
+    Ray ray;
+    Vec3 weight;
+    int pixel;      // Index into the packet
+    int depth;
+};
+
+/*
+ * Whitted ray tracing without recursion. The rays of a packet are traced
+ * breadth first: each pass intersects and shades every queued ray, adds the
+ * light it finds to its pixel, and queues the reflected and refracted rays
+ * for the next pass with the Fresnel weights folded into their throughput.
+ * A ray whose weight falls below min_weight is dropped, so glass no longer
+ * doubles the work at every bounce for light far below one 8-bit step.
+ */
+class WhittedIntegrator : public Integrator {
+public:
+    WhittedIntegrator(const PrimitiveTree& primitives, const std::vector<Light*>& lights, int max_bounces, float min_weight, const Vec3& background_color)
+        : primitives(primitives), lights(lights), max_bounces(max_bounces), min_weight(min_weight), background_color(background_color) {}
+
+    Vec3 radiance(const CameraRay& camera_ray) const override {
+        Vec3 color;
+        radiancePacket(&camera_ray, 1, &color);
+        return color;
     }
 
-    Vec3 hit_point = ray.position(t);
-    Vec3 normal = hitPrimitive->getNormal(hit_point);
-    Vec3 color(0.0f, 0.0f, 0.0f);
+    void radiancePacket(const CameraRay* camera_rays, int count, Vec3* out) const override {
+        std::vector<QueuedRay> queue, next;
+        for (int i = 0; i < count; ++i) {
+            out[i] = Vec3(0.0f);
+            queue.push_back({camera_rays[i].ray, Vec3(1.0f), i, 0});
+        }
 
-    switch (hitPrimitive->material.type) {
-        case REFRACTIVE: {
-            Vec3 reflected_direction = reflection(ray.direction, normal);
-            Ray reflected_ray(hit_point + normal * 1e-3, reflected_direction);
-            Vec3 reflected_color = cast_ray(reflected_ray, primitives, lights, depth + 1, max_bounces, background_color);
-
-            bool isInside = false;
-            Vec3 refracted_direction = refraction(ray.direction, normal, hitPrimitive->material.ior, isInside);
-            Vec3 refracted_color(0.0f);
-            if (refracted_direction != Vec3(0.0f)) {
-                Ray refracted_ray(hit_point + normal * (2*(int)isInside - 1) * 1e-3, refracted_direction);
-                refracted_color = cast_ray(refracted_ray, primitives, lights, depth + 1, max_bounces, background_color);
+        while (!queue.empty()) {
+            next.clear();
+            for (const QueuedRay& queued : queue) {
+                out[queued.pixel] += shade(queued, next);
             }
-
-            float kr = fresnel(ray.direction, normal, hitPrimitive->material.ior);
-            color = reflected_color * kr + refracted_color * (1 - kr);
-            break;
+            std::swap(queue, next);
         }
-        case REFLECTIVE: {
-            Vec3 reflected_direction = reflection(ray.direction, normal);
-            Ray reflected_ray(hit_point + normal * 1e-3, reflected_direction);
-            color = cast_ray(reflected_ray, primitives, lights, depth + 1, max_bounces, background_color);
-            break;
+    }
+
+private:
+    const PrimitiveTree& primitives;
+    const std::vector<Light*>& lights;
+    int max_bounces;
+    float min_weight;
+    Vec3 background_color;
+
+    // Light the ray finds at its first hit, already weighted; secondary rays go to `next`
+    Vec3 shade(const QueuedRay& queued, std::vector<QueuedRay>& next) const {
+        const Ray& ray = queued.ray;
+        float t;
+        Primitive* hitPrimitive;
+
+        if (!primitives.intersect(ray, t, hitPrimitive)) {
+            return queued.weight * background_color;
         }
-        case NONE: {
-            for (const auto& light : lights) {
-                Vec3 light_direction = (light->position - hit_point).normalize();
-                float light_intensity = light->intensity;
-
-                float light_distance_2 = (light->position - hit_point).dot(light->position - hit_point);
-
-                Ray shadow_ray(hit_point + normal * 1e-3, light_direction);
-                float tShadow;
-                Primitive* shadowHitPrimitive;
-                bool isInShadow = primitives.intersect(shadow_ray, tShadow, shadowHitPrimitive) && tShadow * tShadow < light_distance_2;
-
-                if (!isInShadow) {
-                    Vec3 diffuse = hitPrimitive->material.color * hitPrimitive->material.kD * light_intensity * std::max(0.0f, light_direction.dot(normal));
-                    Vec3 reflected_direction = (ray.direction - normal * ray.direction.dot(normal) * 2).normalize();
-                    Vec3 specular = Vec3(1.0f) * hitPrimitive->material.kS * light_intensity * std::pow(std::max(0.0f, reflected_direction.dot(-light_direction)), hitPrimitive->material.shininess);
-                    color += diffuse + specular;
+
+        Vec3 hit_point = ray.position(t);
+        Vec3 normal = hitPrimitive->getNormal(hit_point);
+        Vec3 color(0.0f, 0.0f, 0.0f);
+
+        switch (hitPrimitive->material.type) {
+            case REFRACTIVE: {
+                float kr = fresnel(ray.direction, normal, hitPrimitive->material.ior);
+
+                Vec3 reflected_direction = reflection(ray.direction, normal);
+                spawn(Ray(hit_point + normal * 1e-3, reflected_direction), queued.weight * kr, queued, next, color);
+
+                bool isInside = false;
+                Vec3 refracted_direction = refraction(ray.direction, normal, hitPrimitive->material.ior, isInside);
+                if (refracted_direction != Vec3(0.0f)) {
+                    Ray refracted_ray(hit_point + normal * (2*(int)isInside - 1) * 1e-3, refracted_direction);
+                    spawn(refracted_ray, queued.weight * (1 - kr), queued, next, color);
                 }
+                break;
             }
-            break;
+            case REFLECTIVE: {
+                Vec3 reflected_direction = reflection(ray.direction, normal);
+                spawn(Ray(hit_point + normal * 1e-3, reflected_direction), queued.weight, queued, next, color);
+                break;
+            }
+            case NONE:
+                color = queued.weight * direct_lighting(ray, hit_point, normal, hitPrimitive, primitives, lights);
+                break;
+            default:
+                break;
         }
-        default:
-            break;
-    }
 
-    return color;
-}
+        return color;
+    }
 
-void whitted_ray_tracing(int width, int height, int max_bounces, const std::string& output_path, const Vec3& background_color) {
-    unsigned char* image = new unsigned char[width * height * 3]();
+    // Queues a secondary ray, unless it is too faint to matter or past the bounce limit, where it sees the background
+    void spawn(const Ray& ray, const Vec3& weight, const QueuedRay& parent, std::vector<QueuedRay>& next, Vec3& color) const {
+        if (std::max({weight.x, weight.y, weight.z}) < min_weight) return;
+        if (parent.depth + 1 > max_bounces) {
+            color += weight * background_color;
+            return;
+        }
+        next.push_back({ray, weight, parent.pixel, parent.depth + 1});
+    }
+};
 
-    Vec3 camera(0.0f, 0.0f, 2.0f);
+void whitted_ray_tracing(int width, int height, int max_bounces, float min_weight, bool glass, const std::string& output_path, const Vec3& background_color) {
+    Film film(width, height);
+    Camera camera(Vec3(0.0f, 0.0f, 2.0f), width, height, float(M_PI) / 2.0f);
 
     std::vector<Primitive*> primitivesList;
 
@@ -106,7 +171,7 @@ void whitted_ray_tracing(int width, int height, int max_bounces, const std::stri
             int index = i * 4 + j;
             Vec3 color = colors[index];
             float radius = radii[index];
-            MaterialType matType = materialTypes[index];
+            MaterialType matType = glass ? MaterialType::REFRACTIVE : materialTypes[index];
             Material material(color, Vec3(1.0f), 0.3f, 0.5f, 0.5f, (matType == MaterialType::REFRACTIVE ? 0.8f : 0.0f), 1.5f, 32.0f, matType);
 
             Vec3 position(-3.5f + j * spacing, -1.5f, -8.0f + i * spacing);
@@ -122,21 +187,9 @@ void whitted_ray_tracing(int width, int height, int max_bounces, const std::stri
     std::vector<Light*> lights;
     lights.push_back(new Light(Vec3(0.0f, 0.0f, 5.0f), Vec3(0.0f, 0.0f, -1.0f), 2.0f));
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
-
-            float px = (2 * (x + 0.5f) / float(width) - 1) * width / float(height);
-            float py = (1 - 2 * (y + 0.5f) / float(height));
-
-            Ray ray(camera, Vec3(px, py, -1).normalize());
-            Vec3 color = cast_ray(ray, primitives, lights, 0, max_bounces, background_color);
-
-            image[index] = static_cast<unsigned char>(std::min(color.x * 255.0f, 255.0f));
-            image[index + 1] = static_cast<unsigned char>(std::min(color.y * 255.0f, 255.0f));
-            image[index + 2] = static_cast<unsigned char>(std::min(color.z * 255.0f, 255.0f));
-        }
-    }
+    auto start = std::chrono::steady_clock::now();
+    renderImage(camera, WhittedIntegrator(primitives, lights, max_bounces, min_weight, background_color), film);
+    std::cout << "Rendered in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms" << std::endl;
 
     for (Primitive* primitive : primitivesList) {
         delete primitive;
@@ -146,16 +199,18 @@ void whitted_ray_tracing(int width, int height, int max_bounces, const std::stri
         delete light;
     }
 
-    save_png(output_path.c_str(), image, width, height);
+    if (tileFarmRole() != FarmRole::Worker) film.save(output_path);
     std::cout << "Image saved as " << output_path << std::endl;
-
-    delete[] image;
 }
 
 int main(int argc, char* argv[]) {
+    if (!setupTileFarm(argc, argv)) return 1;
+
     int width = 1280;
     int height = 1024;
     int max_bounces = 50;
+    float min_weight = 1e-3f;
+    bool glass = false;
     std::string output_path = "./results/whitted_ray_tracing.png";
 
     for (int i = 1; i < argc; ++i) {
@@ -165,14 +220,24 @@ int main(int argc, char* argv[]) {
             height = std::atoi(argv[++i]);
         } else if (strcmp(argv[i], "--max-bounces") == 0 && i + 1 < argc) {
             max_bounces = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-weight") == 0 && i + 1 < argc) {
+            min_weight = static_cast<float>(std::atof(argv[++i]));
+        } else if (strcmp(argv[i], "--glass") == 0) {
+            glass = true;
         } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             output_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            TaskPool::setSharedThreadCount(static_cast<unsigned>(std::max(0, std::atoi(argv[++i]))));
         } else if (strcmp(argv[i], "--help") == 0) {
-            std::cout << "Usage: " << argv[0] << " [--width W] [--height H] [--max-bounces M] [--output PATH]\n"
+            std::cout << "Usage: " << argv[0] << " [--width W] [--height H] [--max-bounces M] [--min-weight W] [--glass] [--output PATH] [--threads N] [--farm N]\n"
                       << "  --width       Image width in pixels (default: 1280)\n"
                       << "  --height      Image height in pixels (default: 1024)\n"
                       << "  --max-bounces Maximum number of ray bounces (default: 50)\n"
-                      << "  --output      Output PNG file path (default: ./results/whitted_ray_tracing.png)\n";
+                      << "  --min-weight  Drop secondary rays whose share of the pixel falls below this (default: 0.001)\n"
+                      << "  --glass       Make every sphere refractive\n"
+                      << "  --output      Output PNG file path (default: ./results/whitted_ray_tracing.png)\n"
+                      << "  --threads     Render threads (default: one per hardware thread)\n"
+                      << "  --farm        Split the frame between N worker processes (--farm-timeout S reassigns silent ones)\n";
             return 0;
         } else {
             std::cerr << "Unknown or incomplete argument: " << argv[i] << "\n";
@@ -181,13 +246,13 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (width <= 0 || height <= 0 || max_bounces < 0) {
-        std::cerr << "Invalid arguments: width and height must be positive, max-bounces must be non-negative.\n";
+    if (width <= 0 || height <= 0 || max_bounces < 0 || min_weight < 0.0f) {
+        std::cerr << "Invalid arguments: width and height must be positive, max-bounces and min-weight must be non-negative.\n";
         return 1;
     }
 
     Vec3 background_color(0.0f, 0.0f, 0.0f);
-    whitted_ray_tracing(width, height, max_bounces, output_path, background_color);
+    whitted_ray_tracing(width, height, max_bounces, min_weight, glass, output_path, background_color);
 
     return 0;
 }
\ No newline at end of file